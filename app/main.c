@@ -11,151 +11,114 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include "../src/lab.h"  // Ensure this file contains version macros
-
-// Stores the last stopped process ID
-static pid_t last_stopped_pid = -1;
-
-static void explain_waitpid(int status)
-{
-    if (!WIFEXITED(status))
-    {
-        fprintf(stderr, "Child exited with status %d\n", WEXITSTATUS(status));
-    }
-
-    if (WIFSIGNALED(status))
-    {
-        fprintf(stderr, "Child exited via signal %d\n", WTERMSIG(status));
-    }
-
-    if (WIFSTOPPED(status))
-    {
-        fprintf(stderr, "Child stopped by %d\n", WSTOPSIG(status));
-    }
-
-    if (WIFCONTINUED(status))
-    {
-        fprintf(stderr, "Child was resumed by delivery of SIGCONT\n");
-    }
-}
+#include "../src/heredoc.h"
 
 int main(int argc, char *argv[])
 {
-    int opt;
+    struct shell sh = {0};
 
-    // Parse command-line options
-    while ((opt = getopt(argc, argv, "v")) != -1)
-    {
-        switch (opt)
-        {
-            case 'v':
-                printf("Shell version: %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
-                exit(EXIT_SUCCESS);
-            default:
-                fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
-                exit(EXIT_FAILURE);
-        }
-    }
+    // Parse command-line options: -v, -c command, or a script file
+    parse_args(&sh, argc, argv);
 
-    parse_args(argc, argv);
-    struct shell sh;
-    
     // Initialize shell and set prompt
     sh_init(&sh);
     
     char *line;
+    size_t len;
     while (1)
     {
-        // Update prompt dynamically only if needed
-        if (sh.prompt) free(sh.prompt);
-        sh.prompt = get_prompt("MY_PROMPT");
+        // Tell the user about background jobs that finished or stopped;
+        // scripts just collect them quietly
+        if (sh.shell_is_interactive)
+        {
+            sh_report_jobs(&sh);
+        }
+        else
+        {
+            sh_reap(&sh);
+        }
 
-        // Display shell prompt and read input using readline()
-        line = readline(sh.prompt);
+        // Display shell prompt and read input using readline(). The prompt
+        // is only re-rendered when something it shows has changed. Scripts
+        // and pipes are read in large blocks with no prompt.
+        uint64_t t0 = shstat_now();
+        line = input_next(&sh.input,
+                          sh.shell_is_interactive ? sh_prompt(&sh) : NULL, &len);
+        shstat_add(&sh.stats, STAT_READ, t0);
 
         // If user presses Ctrl+D (EOF), exit the shell
         if (!line)
         {
-            printf("\nExiting shell...\n");
-            free(sh.prompt);
+            if (sh.shell_is_interactive)
+            {
+                printf("\nExiting shell...\n");
+            }
             break;
         }
 
-        // Trim whitespace
-        line = trim_white(line);
-        if (!*line)  // Ignore empty input
+        // Trim whitespace. Lines of a mapped script are read-only, so the
+        // trimmed span is described by a pointer and a length.
+        const char *cmdline = trim_white_n(line, &len);
+        if (len == 0)  // Ignore empty input
         {
-            free(line);
+            arena_reset(&sh.arena);
             continue;
         }
 
-        // Add command to history
-        add_history(line);
-
-        // Parse command
-        char **cmd = cmd_parse(line);
-
-        // Execute built-in command first (no forking needed)
-        if (do_builtin(&sh, cmd))
+        // Add command to history and HISTFILE; readline's buffer is ours
+        // to terminate
+        if (sh.shell_is_interactive)
         {
-            cmd_free(cmd);  // Free memory if it's a built-in command
-        } 
-        else 
-        {
-            // Fork and execute external command
-            pid_t pid = fork();
-            if (pid == 0)
-            {
-                // Child process
-                pid_t child = getpid();
-                setpgid(child, child);
-                tcsetpgrp(sh.shell_terminal, child);
-
-                // Restore default signal handling in child
-                signal(SIGINT, SIG_DFL);
-                signal(SIGQUIT, SIG_DFL);
-                signal(SIGTSTP, SIG_DFL);
-                signal(SIGTTIN, SIG_DFL);
-                signal(SIGTTOU, SIG_DFL);
+            line[cmdline - line + len] = '\0';
+            sh_add_history(&sh, cmdline, len);
+        }
 
-                // Execute the command
-                execvp(cmd[0], cmd);
-                perror("execvp failed");  // Print error if execvp fails
-                exit(EXIT_FAILURE);
-            }
-            else if (pid < 0)
-            {
-                perror("fork return < 0 Process creation failed!");
-                abort();
-            }
+        // A line run before reuses its tree from the parse cache. Otherwise
+        // the whole line, which may be a list of commands, is parsed straight
+        // from the input into the arena; a line that keeps coming back is
+        // copied into the cache.
+        t0 = shstat_now();
+        struct node *parsed;
+        enum parse_status status;
+        const struct node *list = ast_cache_parse(&sh.ast_cache, &sh.arena, cmdline, len,
+                                                  &parsed, &status);
+        shstat_add(&sh.stats, list && !parsed ? STAT_PARSE_HIT : STAT_PARSE, t0);
+
+        // A syntax error fails with status 2, as in bash; a line that is
+        // only a comment leaves $? alone
+        if (status == PARSE_SYNTAX || status == PARSE_NOMEM)
+        {
+            sh.last_status = 2;
+        }
 
-            // Parent process: set child as foreground process and wait for it
-            setpgid(pid, pid);
-            tcsetpgrp(sh.shell_terminal, pid);
-            
-            int status;
-            int rval = waitpid(pid, &status, WUNTRACED);
-            if (rval == -1)
+        // Here-document bodies are the lines after the command; trees with
+        // here-documents are never cached, so they are always our own
+        if (parsed && parsed->nheredocs)
+        {
+            t0 = shstat_now();
+            if (heredoc_read(parsed, &sh.input, sh.shell_is_interactive ? HEREDOC_PROMPT : NULL,
+                             &sh.arena) != 0)
             {
-                fprintf(stderr, "Wait pid failed with -1\n");
-                explain_waitpid(status);
-            }
-
-            // Restore control to the shell after child process ends
-            tcsetpgrp(sh.shell_terminal, sh.shell_pgid);
-
-            // Handle stopped process (Ctrl+Z)
-            if (WIFSTOPPED(status)) {
-                fprintf(stderr, "Process %d stopped\n", pid);
-                last_stopped_pid = pid;  // Store stopped job
+                heredoc_close(parsed);
+                list = NULL;
+                sh.last_status = 1;
             }
+            shstat_add(&sh.stats, STAT_READ, t0);
+        }
 
-            // Free allocated command memory
-            cmd_free(cmd);
+        // Run the list; each pipeline's status lands in sh.last_status
+        if (list)
+        {
+            exec_node(&sh, list);
+            if (parsed) heredoc_close(parsed);
         }
 
-        // Free input line
-        free(line);
+        // The line belongs to the input and is released by the next read;
+        // everything this command allocated goes in one step
+        arena_reset(&sh.arena);
     }
 
-    return 0;
+    int status = sh.last_status;
+    sh_destroy(&sh);
+    return status;
 }
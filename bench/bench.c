@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../src/lab.h"
+#include "../src/parse.h"
+#include "../src/proc.h"
+
+// Run each benchmark for at least this long once the iteration count is
+// calibrated
+#define BENCH_MIN_NS 200000000ULL
+
+// Every allocation made by the benchmarked code is counted by interposing
+// the allocator entry points; glibc routes its own strdup, getline, etc.
+// through these symbols too
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long alloc_count;
+
+void *malloc(size_t size)
+{
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+struct bench
+{
+    const char *name;
+    void (*fn)(struct shell *sh, unsigned long n);
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// A typical interactive command line
+static const char LINE[] = "ls -la --color=auto /usr/share/doc | grep -i 'read me' | wc -l";
+
+static void bench_cmd_parse(struct shell *sh, unsigned long n)
+{
+    UNUSED(sh);
+    for (unsigned long i = 0; i < n; i++)
+    {
+        char **argv = cmd_parse(LINE);
+        cmd_free(argv);
+    }
+}
+
+// The shell parses every line with parse_line into a tree
+static void bench_parse_line(struct shell *sh, unsigned long n)
+{
+    for (unsigned long i = 0; i < n; i++)
+    {
+        parse_line(&sh->arena, LINE, sizeof(LINE) - 1, NULL);
+        arena_reset(&sh->arena);
+    }
+}
+
+// A line run before: the main loop finds its tree in the parse cache
+static void bench_ast_cache_hit(struct shell *sh, unsigned long n)
+{
+    struct node *parsed;
+    for (unsigned long i = 0; i < n; i++)
+    {
+        ast_cache_parse(&sh->ast_cache, &sh->arena, LINE, sizeof(LINE) - 1, &parsed, NULL);
+        arena_reset(&sh->arena);
+    }
+}
+
+// Lines that never repeat, as in a long script: every one is parsed, and
+// the cache should add next to nothing on top of parse_line
+static void bench_ast_cache_miss(struct shell *sh, unsigned long n)
+{
+    static unsigned long serial;
+    char line[sizeof(LINE) + 24];
+    struct node *parsed;
+    for (unsigned long i = 0; i < n; i++)
+    {
+        // Same length as LINE, so the hash covers as many bytes
+        int len = snprintf(line, sizeof(line), "%08lx%s", serial++, LINE + 8);
+        ast_cache_parse(&sh->ast_cache, &sh->arena, line, len, &parsed, NULL);
+        arena_reset(&sh->arena);
+    }
+}
+
+static void bench_trim_white(struct shell *sh, unsigned long n)
+{
+    UNUSED(sh);
+    static const char padded[] = "   \t  echo hello world   \t  ";
+    char buf[sizeof(padded)];
+    for (unsigned long i = 0; i < n; i++)
+    {
+        // trim_white writes over the trailing blanks, so restore them
+        memcpy(buf, padded, sizeof(padded));
+        trim_white(buf);
+    }
+}
+
+static void bench_get_prompt(struct shell *sh, unsigned long n)
+{
+    UNUSED(sh);
+    for (unsigned long i = 0; i < n; i++)
+    {
+        free(get_prompt("MY_PROMPT"));
+    }
+}
+
+static void bench_sh_prompt(struct shell *sh, unsigned long n)
+{
+    for (unsigned long i = 0; i < n; i++)
+    {
+        sh_prompt(sh);
+    }
+}
+
+static void bench_is_builtin(struct shell *sh, unsigned long n)
+{
+    UNUSED(sh);
+    static const char *const names[] = { "ls", "cd", "grep", "history" };
+    for (unsigned long i = 0; i < n; i++)
+    {
+        is_builtin(names[i & 3]);
+    }
+}
+
+static void bench_do_builtin(struct shell *sh, unsigned long n)
+{
+    static char *argv[] = { "hash", "ls", NULL };
+    // Output really goes somewhere, so flushing costs what it would
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("/dev/null");
+        exit(EXIT_FAILURE);
+    }
+    struct sink out;
+    sink_init(&out, fd);
+    for (unsigned long i = 0; i < n; i++)
+    {
+        do_builtin_sink(sh, argv, &out);
+    }
+    sink_flush(&out);
+    close(fd);
+}
+
+static void bench_spawn_true(struct shell *sh, unsigned long n)
+{
+    UNUSED(sh);
+    static char *argv[] = { "/bin/true", NULL };
+    for (unsigned long i = 0; i < n; i++)
+    {
+        pid_t pid = spawn_cmd("/bin/true", argv, -1, -1, -1, -1, NULL);
+        if (pid > 0) waitpid(pid, NULL, 0);
+    }
+}
+
+static void bench_fork_exec_true(struct shell *sh, unsigned long n)
+{
+    UNUSED(sh);
+    static char *argv[] = { "/bin/true", NULL };
+    for (unsigned long i = 0; i < n; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            execv(argv[0], argv);
+            _exit(127);
+        }
+        if (pid > 0) waitpid(pid, NULL, 0);
+    }
+}
+
+static void bench_exec_node(struct shell *sh, unsigned long n)
+{
+    static const char cmd[] = "/bin/true";
+    for (unsigned long i = 0; i < n; i++)
+    {
+        struct node *list = parse_line(&sh->arena, cmd, sizeof(cmd) - 1, NULL);
+        if (list) exec_node(sh, list);
+        arena_reset(&sh->arena);
+    }
+}
+
+static const struct bench benches[] = {
+    { "cmd_parse+cmd_free", bench_cmd_parse },
+    { "parse_line", bench_parse_line },
+    { "ast_cache hit", bench_ast_cache_hit },
+    { "ast_cache miss+parse_line", bench_ast_cache_miss },
+    { "trim_white", bench_trim_white },
+    { "get_prompt+free", bench_get_prompt },
+    { "sh_prompt (cached)", bench_sh_prompt },
+    { "is_builtin", bench_is_builtin },
+    { "do_builtin hash ls", bench_do_builtin },
+    { "spawn_cmd /bin/true", bench_spawn_true },
+    { "fork+execv /bin/true", bench_fork_exec_true },
+    { "exec_node /bin/true", bench_exec_node },
+};
+
+// Doubles the iteration count until one run takes BENCH_MIN_NS, then
+// reports that run
+static void run(struct shell *sh, const struct bench *b, FILE *out)
+{
+    unsigned long n = 1;
+    unsigned long long ns, allocs;
+    for (;;)
+    {
+        allocs = alloc_count;
+        unsigned long long t0 = now_ns();
+        b->fn(sh, n);
+        ns = now_ns() - t0;
+        allocs = alloc_count - allocs;
+        if (ns >= BENCH_MIN_NS) break;
+        n *= 2;
+    }
+
+    char row[160];
+    snprintf(row, sizeof(row), "%-26s %12.1f ns/op %8.2f allocs/op %10lu iters\n",
+             b->name, (double)ns / n, (double)allocs / n, n);
+    fputs(row, stdout);
+    if (out) fputs(row, out);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "bench_output.txt";
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    // A -c shell never touches the terminal, so the benchmark can run from
+    // anywhere without stealing the foreground
+    struct shell sh = {0};
+    sh.command = "";
+    sh_init(&sh);
+    cmd_hash_lookup(&sh.cmd_hash, "ls");
+
+    fprintf(out, "Shell version: %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+    {
+        fflush(stdout);
+        fflush(out);
+        run(&sh, &benches[i], out);
+    }
+
+    sh_destroy(&sh);
+    fclose(out);
+    return 0;
+}
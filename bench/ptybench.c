@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Prompt the shell is started with; seeing it again means the previous
+// command has finished. It must not occur in any command's output.
+#define SENTINEL "@@ptybench@@ "
+
+// Give up on a command that has not produced a prompt after this long
+#define TIMEOUT_MS 10000
+
+struct workload
+{
+    const char *name;
+    const char *const *cmds;
+};
+
+static const char *const builtin_cmds[] = { "cd .", "hash", "jobs", NULL };
+static const char *const exec_cmds[] = { "/bin/true", "true", NULL };
+static const char *const pipeline_cmds[] = { "true | true", "echo hi | cat", "printf x | cat | cat", NULL };
+static const char *const mixed_cmds[] = { "cd .", "/bin/true", "echo hi | cat", "jobs", "true", NULL };
+
+static const struct workload workloads[] = {
+    { "builtin", builtin_cmds },
+    { "exec", exec_cmds },
+    { "pipeline", pipeline_cmds },
+    { "mixed", mixed_cmds },
+};
+
+struct shell_pty
+{
+    int fd;
+    pid_t pid;
+    char tail[sizeof(SENTINEL)];  // End of the output seen so far
+    size_t ntail;
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// Reads shell output until the prompt appears. Only the last few bytes are
+// kept so a prompt split across two reads is still found.
+static int wait_prompt(struct shell_pty *p)
+{
+    const size_t slen = sizeof(SENTINEL) - 1;
+    char buf[4096 + sizeof(SENTINEL)];
+    for (;;)
+    {
+        struct pollfd pfd = { .fd = p->fd, .events = POLLIN };
+        int r = poll(&pfd, 1, TIMEOUT_MS);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0)
+        {
+            fprintf(stderr, "ptybench: timed out waiting for the prompt\n");
+            return -1;
+        }
+
+        memcpy(buf, p->tail, p->ntail);
+        ssize_t n = read(p->fd, buf + p->ntail, 4096);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "ptybench: shell exited\n");
+            return -1;
+        }
+        size_t len = p->ntail + (size_t)n;
+
+        char *hit = memmem(buf, len, SENTINEL, slen);
+        if (hit)
+        {
+            // The prompt is the last thing the shell writes before it waits
+            p->ntail = 0;
+            return 0;
+        }
+        p->ntail = len < slen - 1 ? len : slen - 1;
+        memcpy(p->tail, buf + len - p->ntail, p->ntail);
+    }
+}
+
+static int start_shell(struct shell_pty *p, char **argv)
+{
+    struct winsize ws = { .ws_row = 50, .ws_col = 250 };
+    p->ntail = 0;
+    p->pid = forkpty(&p->fd, NULL, NULL, &ws);
+    if (p->pid < 0)
+    {
+        perror("forkpty");
+        return -1;
+    }
+    if (p->pid == 0)
+    {
+        setenv("MY_PROMPT", SENTINEL, 1);
+        // An empty HISTFILE saves nothing: the benchmark's commands stay
+        // out of the user's history, and no append is timed with them
+        setenv("HISTFILE", "", 1);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    return wait_prompt(p);
+}
+
+static void stop_shell(struct shell_pty *p)
+{
+    static const char bye[] = "exit\n";
+    if (write(p->fd, bye, sizeof(bye) - 1) < 0) kill(p->pid, SIGKILL);
+
+    // Drain the output so the shell is never blocked writing to the pty
+    char buf[4096];
+    struct pollfd pfd = { .fd = p->fd, .events = POLLIN };
+    while (poll(&pfd, 1, 1000) > 0 && read(p->fd, buf, sizeof(buf)) > 0)
+        ;
+    close(p->fd);
+    waitpid(p->pid, NULL, 0);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sends n commands one at a time, each as soon as the previous prompt is
+// back, and reports throughput and latency percentiles
+static int run(char **argv, const struct workload *w, unsigned long n, FILE *out)
+{
+    struct shell_pty p;
+    if (start_shell(&p, argv) != 0) return -1;
+
+    unsigned long long *lat = malloc(n * sizeof(*lat));
+    if (!lat)
+    {
+        perror("malloc");
+        stop_shell(&p);
+        return -1;
+    }
+
+    int rc = 0;
+    unsigned long long start = now_ns();
+    size_t k = 0;
+    for (unsigned long i = 0; i < n; i++)
+    {
+        if (!w->cmds[k]) k = 0;
+        char line[256];
+        int len = snprintf(line, sizeof(line), "%s\n", w->cmds[k++]);
+
+        unsigned long long t0 = now_ns();
+        if (write(p.fd, line, (size_t)len) != len || wait_prompt(&p) != 0)
+        {
+            rc = -1;
+            n = i;
+            break;
+        }
+        lat[i] = now_ns() - t0;
+    }
+    unsigned long long total = now_ns() - start;
+    stop_shell(&p);
+
+    if (n > 0)
+    {
+        qsort(lat, n, sizeof(*lat), cmp_ull);
+        char row[160];
+        snprintf(row, sizeof(row), "%-10s %8lu cmds %10.0f cmds/s   p50 %8.1f us   p99 %8.1f us\n",
+                 w->name, n, n / (total / 1e9), lat[n / 2] / 1e3, lat[n * 99 / 100] / 1e3);
+        fputs(row, stdout);
+        if (out) fputs(row, out);
+    }
+    free(lat);
+    return rc;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n count] [-w workload] [-o file] [shell [args...]]\n"
+                    "Workloads: builtin, exec, pipeline, mixed (default: all)\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long n = 2000;
+    const char *only = NULL;
+    const char *path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+n:w:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                n = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                only = optarg;
+                break;
+            case 'o':
+                path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    static char *default_shell[] = { "./myprogram", NULL };
+    char **shell = optind < argc ? argv + optind : default_shell;
+
+    FILE *out = NULL;
+    if (path && !(out = fopen(path, "a")))
+    {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    int rc = 0;
+    int ran = 0;
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+    {
+        if (only && strcmp(only, workloads[i].name) != 0) continue;
+        ran = 1;
+        fflush(stdout);
+        if (run(shell, &workloads[i], n, out) != 0) rc = EXIT_FAILURE;
+    }
+    if (!ran)
+    {
+        usage(argv[0]);
+        rc = EXIT_FAILURE;
+    }
+
+    if (out) fclose(out);
+    return rc;
+}
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+// Allocates a chunk with room for at least n bytes
+static struct arena_chunk *chunk_new(size_t n) {
+    struct arena_chunk *c = malloc(sizeof(*c) + n);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->size = n;
+    c->used = 0;
+    return c;
+}
+
+void arena_init(struct arena *a, size_t chunk_size) {
+    a->head = NULL;
+    a->cur = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+    a->allocated = 0;
+}
+
+void *arena_alloc(struct arena *a, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    // Walk forward through chunks left over from before the last reset
+    while (a->cur && a->cur->size - a->cur->used < n && a->cur->next) {
+        a->cur = a->cur->next;
+    }
+
+    if (!a->cur || a->cur->size - a->cur->used < n) {
+        struct arena_chunk *c = chunk_new(n > a->chunk_size ? n : a->chunk_size);
+        if (!c) return NULL;
+        if (a->cur) {
+            a->cur->next = c;
+        } else {
+            a->head = c;
+        }
+        a->cur = c;
+    }
+
+    void *p = (char *)a->cur->data + a->cur->used;
+    a->cur->used += n;
+    a->allocated += n;
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n) {
+    char *p = arena_alloc(a, n + 1);
+    if (!p) return NULL;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+void arena_reset(struct arena *a) {
+    size_t kept = 0;
+    struct arena_chunk **link = &a->head;
+
+    // Keep chunks up to the retain budget, free the rest
+    while (*link) {
+        struct arena_chunk *c = *link;
+        if (kept + c->size > ARENA_RETAIN_BYTES && kept > 0) {
+            *link = c->next;
+            free(c);
+            continue;
+        }
+        c->used = 0;
+        kept += c->size;
+        link = &c->next;
+    }
+    a->cur = a->head;
+}
+
+void arena_destroy(struct arena *a) {
+    struct arena_chunk *c = a->head;
+    while (c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = NULL;
+    a->cur = NULL;
+}
@@ -0,0 +1,89 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Default size of each arena chunk */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Chunks beyond this many bytes are returned to malloc on reset */
+#define ARENA_RETAIN_BYTES (1024 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+struct arena {
+    struct arena_chunk *head;
+    struct arena_chunk *cur;
+    size_t chunk_size;
+    size_t allocated;   // Bytes handed out since arena_init, for shstat
+};
+
+/**
+ * @brief Initialize an empty arena. No memory is allocated until the first
+ * call to arena_alloc.
+ *
+ * @param a The arena to initialize
+ * @param chunk_size Size of each chunk, or 0 for ARENA_CHUNK_SIZE
+ */
+void arena_init(struct arena *a, size_t chunk_size);
+
+/**
+ * @brief Allocate n bytes from the arena, aligned for any type. The memory
+ * stays valid until the next arena_reset or arena_destroy.
+ *
+ * @param a The arena
+ * @param n Number of bytes
+ * @return Pointer to the memory, or NULL if a new chunk could not be allocated
+ */
+void *arena_alloc(struct arena *a, size_t n);
+
+/**
+ * @brief Copy the first n bytes of s into the arena and NUL-terminate it.
+ *
+ * @param a The arena
+ * @param s The source string
+ * @param n Number of bytes to copy
+ * @return The copy, or NULL on allocation failure
+ */
+char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+/**
+ * @brief Copy a NUL-terminated string into the arena.
+ *
+ * @param a The arena
+ * @param s The string to copy
+ * @return The copy, or NULL on allocation failure
+ */
+char *arena_strdup(struct arena *a, const char *s);
+
+/**
+ * @brief Release everything allocated from the arena in one step. Chunks are
+ * kept for reuse (up to ARENA_RETAIN_BYTES) so a steady-state workload makes
+ * no further calls to malloc or free.
+ *
+ * @param a The arena
+ */
+void arena_reset(struct arena *a);
+
+/**
+ * @brief Free all chunks owned by the arena.
+ *
+ * @param a The arena
+ */
+void arena_destroy(struct arena *a);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
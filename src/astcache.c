@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include "astcache.h"
+#include "fnv.h"
+
+static struct ast_cache_entry **bucket(struct ast_cache *c, uint64_t hash) {
+    return &c->buckets[hash & (AST_CACHE_BUCKETS - 1)];
+}
+
+static void unlink_recent(struct ast_cache *c, struct ast_cache_entry *e) {
+    if (e->newer) e->newer->older = e->older; else c->newest = e->older;
+    if (e->older) e->older->newer = e->newer; else c->oldest = e->newer;
+}
+
+static void push_newest(struct ast_cache *c, struct ast_cache_entry *e) {
+    e->newer = NULL;
+    e->older = c->newest;
+    if (c->newest) c->newest->newer = e; else c->oldest = e;
+    c->newest = e;
+}
+
+static void drop(struct ast_cache *c, struct ast_cache_entry *e) {
+    struct ast_cache_entry **link = bucket(c, e->hash);
+    while (*link != e) link = &(*link)->next;
+    *link = e->next;
+    unlink_recent(c, e);
+    arena_destroy(&e->arena);
+    free(e);
+    c->count--;
+}
+
+void ast_cache_init(struct ast_cache *c) {
+    memset(c, 0, sizeof(*c));
+}
+
+void ast_cache_destroy(struct ast_cache *c) {
+    while (c->oldest) drop(c, c->oldest);
+}
+
+// The tree cached for line, which becomes the most recently used
+static const struct node *lookup(struct ast_cache *c, uint64_t h, const char *line,
+                                 size_t len) {
+    for (struct ast_cache_entry *e = *bucket(c, h); e; e = e->next) {
+        if (e->hash != h || e->len != len || memcmp(e->line, line, len) != 0) continue;
+        if (c->newest != e) {
+            unlink_recent(c, e);
+            push_newest(c, e);
+        }
+        return e->tree;
+    }
+    return NULL;
+}
+
+// Copies tree into a new entry if line has been seen before, otherwise
+// only notes its hash
+static void insert(struct ast_cache *c, uint64_t h, const char *line, size_t len,
+                   const struct node *tree) {
+    uint64_t *seen = &c->seen[h & (AST_CACHE_SEEN - 1)];
+    if (*seen != h) {
+        *seen = h;
+        return;
+    }
+    if (c->count >= AST_CACHE_SIZE) drop(c, c->oldest);
+
+    struct ast_cache_entry *e = malloc(sizeof(*e));
+    if (!e) return;
+    arena_init(&e->arena, AST_CACHE_CHUNK);
+    e->line = arena_strndup(&e->arena, line, len);
+    e->tree = e->line ? parse_copy(&e->arena, tree) : NULL;
+    if (!e->tree) {
+        arena_destroy(&e->arena);
+        free(e);
+        return;
+    }
+    e->len = len;
+    e->hash = h;
+
+    struct ast_cache_entry **head = bucket(c, h);
+    e->next = *head;
+    *head = e;
+    push_newest(c, e);
+    c->count++;
+}
+
+const struct node *ast_cache_parse(struct ast_cache *c, struct arena *arena,
+                                   const char *line, size_t len, struct node **parsed,
+                                   enum parse_status *status) {
+    uint64_t h = fnv1a(line, len);
+    const struct node *tree = lookup(c, h, line, len);
+    *parsed = NULL;
+    if (tree) {
+        if (status) *status = PARSE_OK;
+        return tree;
+    }
+
+    *parsed = parse_line(arena, line, len, status);
+    if (*parsed && (*parsed)->nheredocs == 0) insert(c, h, line, len, *parsed);
+    return *parsed;
+}
@@ -0,0 +1,90 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Most parsed lines kept; the least recently used one is dropped first */
+#define AST_CACHE_SIZE 64
+
+/* Hash buckets; a power of two, twice AST_CACHE_SIZE so chains stay short */
+#define AST_CACHE_BUCKETS 128
+
+/* Hashes of lines parsed once and not yet cached; a power of two */
+#define AST_CACHE_SEEN 256
+
+/* Each cached tree lives in its own arena, so it can be dropped on its own.
+ * Most lines fit in one chunk of this size. */
+#define AST_CACHE_CHUNK 1024
+
+struct ast_cache_entry {
+    struct ast_cache_entry *next;   // Hash chain
+    struct ast_cache_entry *newer;  // Recency list, most recent first
+    struct ast_cache_entry *older;
+    uint64_t hash;
+    const char *line;               // The command text, in the entry's arena
+    size_t len;
+    const struct node *tree;
+    struct arena arena;
+};
+
+/* Command line -> parsed tree, for lines that are run again and again */
+struct ast_cache {
+    struct ast_cache_entry *buckets[AST_CACHE_BUCKETS];
+    struct ast_cache_entry *newest;
+    struct ast_cache_entry *oldest;
+    size_t count;
+    uint64_t seen[AST_CACHE_SEEN];  // Direct-mapped by hash; a newer line overwrites
+};
+
+/**
+ * @brief Initialize an empty cache.
+ *
+ * @param c The cache
+ */
+void ast_cache_init(struct ast_cache *c);
+
+/**
+ * @brief Free every entry.
+ *
+ * @param c The cache
+ */
+void ast_cache_destroy(struct ast_cache *c);
+
+/**
+ * @brief The tree for a command line: the cached one if the line was run
+ * before, otherwise a fresh parse_line into the arena. The first time a
+ * line is parsed only its hash is noted, so a stream of lines that never
+ * repeat costs no allocation; when it comes again a copy of its tree goes
+ * into the cache, dropping the least recently used line if it is full.
+ * Trees with here-documents are never cached, since their bodies are read
+ * afresh each time and stored in the tree.
+ *
+ * A cached tree is shared by every run of the line and must not be
+ * changed; it stays valid until the next call.
+ *
+ * @param c The cache
+ * @param arena The arena to parse into
+ * @param line The command line, already trimmed
+ * @param len Number of bytes in the line
+ * @param parsed Receives the tree when it was parsed rather than found in
+ * the cache (and may be changed, e.g. by heredoc_read), otherwise NULL
+ * @param status Receives how parsing went, as from parse_line; may be NULL
+ * @return The tree, or NULL as parse_line returns it
+ */
+const struct node *ast_cache_parse(struct ast_cache *c, struct arena *arena,
+                                   const char *line, size_t len, struct node **parsed,
+                                   enum parse_status *status);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cmdhash.h"
+#include "fnv.h"
+#include "sink.h"
+
+#define CMD_HASH_INITIAL 64
+
+static size_t hash_name(const char *s) {
+    return (size_t)fnv1a(s, strlen(s));
+}
+
+// Checks that path is a regular file we are allowed to execute
+static int is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Walks PATH the way execvp does and returns a malloc'd absolute path
+static char *search_path(const char *name, const char *path_env) {
+    size_t nlen = strlen(name);
+    const char *dir = path_env ? path_env : "/bin:/usr/bin";
+
+    for (;;) {
+        const char *end = strchr(dir, ':');
+        size_t dlen = end ? (size_t)(end - dir) : strlen(dir);
+
+        // An empty PATH element means the current directory
+        if (dlen == 0) {
+            dir = ".";
+            dlen = 1;
+        }
+        char *full = malloc(dlen + nlen + 2);
+        if (!full) return NULL;
+        memcpy(full, dir, dlen);
+        full[dlen] = '/';
+        memcpy(full + dlen + 1, name, nlen + 1);
+        if (is_executable(full)) return full;
+        free(full);
+
+        if (!end) return NULL;
+        dir = end + 1;
+    }
+}
+
+// Drops the table if PATH differs from what the entries were resolved with
+static void check_path(struct cmd_hash *h) {
+    const char *cur = getenv("PATH");
+    if (h->path_env == NULL && cur == NULL) return;
+    if (h->path_env && cur && strcmp(h->path_env, cur) == 0) return;
+
+    cmd_hash_clear(h);
+    free(h->path_env);
+    h->path_env = cur ? strdup(cur) : NULL;
+}
+
+static int grow(struct cmd_hash *h) {
+    size_t n = h->nbuckets ? h->nbuckets * 2 : CMD_HASH_INITIAL;
+    struct cmd_hash_entry **b = calloc(n, sizeof(*b));
+    if (!b) return -1;
+
+    for (size_t i = 0; i < h->nbuckets; i++) {
+        struct cmd_hash_entry *e = h->buckets[i];
+        while (e) {
+            struct cmd_hash_entry *next = e->next;
+            size_t slot = hash_name(e->name) & (n - 1);
+            e->next = b[slot];
+            b[slot] = e;
+            e = next;
+        }
+    }
+    free(h->buckets);
+    h->buckets = b;
+    h->nbuckets = n;
+    return 0;
+}
+
+void cmd_hash_init(struct cmd_hash *h) {
+    h->buckets = NULL;
+    h->nbuckets = 0;
+    h->count = 0;
+    h->path_env = NULL;
+}
+
+void cmd_hash_destroy(struct cmd_hash *h) {
+    cmd_hash_clear(h);
+    free(h->buckets);
+    free(h->path_env);
+    cmd_hash_init(h);
+}
+
+const char *cmd_hash_lookup(struct cmd_hash *h, const char *name) {
+    if (!name || !*name) return NULL;
+    if (strchr(name, '/')) return name;
+
+    check_path(h);
+
+    if (h->nbuckets) {
+        struct cmd_hash_entry *e = h->buckets[hash_name(name) & (h->nbuckets - 1)];
+        for (; e; e = e->next) {
+            if (strcmp(e->name, name) == 0) {
+                e->hits++;
+                return e->path;
+            }
+        }
+    }
+
+    char *path = search_path(name, h->path_env);
+    if (!path) return NULL;
+
+    if (h->count >= h->nbuckets && grow(h) != 0) {
+        free(path);
+        return NULL;
+    }
+
+    // Entry and name share an allocation; the path is owned separately
+    size_t nlen = strlen(name);
+    struct cmd_hash_entry *e = malloc(sizeof(*e) + nlen + 1);
+    if (!e) {
+        free(path);
+        return NULL;
+    }
+    e->name = (char *)(e + 1);
+    memcpy(e->name, name, nlen + 1);
+    e->path = path;
+    e->hits = 1;
+
+    size_t slot = hash_name(name) & (h->nbuckets - 1);
+    e->next = h->buckets[slot];
+    h->buckets[slot] = e;
+    h->count++;
+    return e->path;
+}
+
+void cmd_hash_forget(struct cmd_hash *h, const char *name) {
+    if (!h->nbuckets || !name) return;
+
+    struct cmd_hash_entry **link = &h->buckets[hash_name(name) & (h->nbuckets - 1)];
+    while (*link) {
+        struct cmd_hash_entry *e = *link;
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            free(e->path);
+            free(e);
+            h->count--;
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+void cmd_hash_clear(struct cmd_hash *h) {
+    for (size_t i = 0; i < h->nbuckets; i++) {
+        struct cmd_hash_entry *e = h->buckets[i];
+        while (e) {
+            struct cmd_hash_entry *next = e->next;
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        h->buckets[i] = NULL;
+    }
+    h->count = 0;
+}
+
+void cmd_hash_print(const struct cmd_hash *h, struct sink *out) {
+    if (h->count == 0) {
+        sink_printf(out, "hash: hash table empty\n");
+        return;
+    }
+    sink_printf(out, "hits\tcommand\n");
+    for (size_t i = 0; i < h->nbuckets; i++) {
+        for (struct cmd_hash_entry *e = h->buckets[i]; e; e = e->next) {
+            sink_printf(out, "%4lu\t%s\n", e->hits, e->path);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct sink;
+
+struct cmd_hash_entry {
+    struct cmd_hash_entry *next;
+    unsigned long hits;
+    char *name;
+    char *path;
+};
+
+struct cmd_hash {
+    struct cmd_hash_entry **buckets;
+    size_t nbuckets;
+    size_t count;
+    char *path_env;  // PATH the cached entries were resolved against
+};
+
+/**
+ * @brief Initialize an empty command hash.
+ *
+ * @param h The hash to initialize
+ */
+void cmd_hash_init(struct cmd_hash *h);
+
+/**
+ * @brief Free every entry and the bucket array.
+ *
+ * @param h The hash to destroy
+ */
+void cmd_hash_destroy(struct cmd_hash *h);
+
+/**
+ * @brief Resolve a command name to an absolute path. Names containing a '/'
+ * are returned unchanged. Otherwise the cached path is returned, or PATH is
+ * searched once and the result is remembered. The whole table is dropped
+ * if PATH has changed since the entries were cached.
+ *
+ * @param h The hash
+ * @param name The command name
+ * @return The path to exec (owned by the hash), or NULL if not found
+ */
+const char *cmd_hash_lookup(struct cmd_hash *h, const char *name);
+
+/**
+ * @brief Forget the cached path for one command, e.g. after exec of the
+ * cached path failed with ENOENT.
+ *
+ * @param h The hash
+ * @param name The command name
+ */
+void cmd_hash_forget(struct cmd_hash *h, const char *name);
+
+/**
+ * @brief Forget every cached path (hash -r).
+ *
+ * @param h The hash
+ */
+void cmd_hash_clear(struct cmd_hash *h);
+
+/**
+ * @brief Print the table in the same "hits<TAB>command" layout as bash.
+ *
+ * @param h The hash
+ * @param out Where to write
+ */
+void cmd_hash_print(const struct cmd_hash *h, struct sink *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "exec.h"
+#include "jobs.h"
+#include "lab.h"
+#include "proc.h"
+#include "timing.h"
+
+// Without a SIGCHLD signalfd, how often a builtin stage that is waiting for
+// pipe room checks on its pipeline
+#define STAGE_POLL_MS 100
+
+// Runs a builtin or a group's list in the current process
+static int run_here(struct shell *sh, const struct command *cmd) {
+    if (cmd->body) return exec_node(sh, cmd->body);
+    return do_builtin(sh, cmd->argv) ? 0 : 1;
+}
+
+// Runs a builtin that changes shell state, or a ( ) or { } group, as a
+// pipeline stage or in the background. Like any other shell, the change
+// must not leak back, so it gets a forked child. The child is a subshell:
+// it does no job control, so its commands stay in its process group.
+// next_in is the read end of the pipe out_fd writes to, or -1.
+static pid_t launch_forked(struct shell *sh, const struct command *cmd, pid_t pgid,
+                           int tty, int in_fd, int out_fd, int next_in,
+                           const struct redirs *rs) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        child_setup(pgid, tty, in_fd, out_fd);
+        // Nothing here is exec'd, so close-on-exec does not apply: the pipe
+        // ends must be closed by hand, or holding the read end of its own
+        // output would keep the child from ever seeing EPIPE
+        int ends[] = { in_fd, out_fd, next_in };
+        for (size_t i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+            if (ends[i] > STDERR_FILENO) close(ends[i]);
+        }
+        if (redir_apply(rs) != 0) _exit(1);
+        sh->shell_is_interactive = false;
+        int status = run_here(sh, cmd);
+        fflush(stdout);
+        _exit(status);
+    }
+    return pid;
+}
+
+// Resolves and starts one external stage, reporting failures like bash
+static pid_t launch_external(struct shell *sh, char **argv, pid_t pgid, int tty,
+                             int in_fd, int out_fd, const struct redirs *rs) {
+    const char *path = cmd_hash_lookup(&sh->cmd_hash, argv[0]);
+    pid_t pid = path ? spawn_cmd(path, argv, pgid, tty, in_fd, out_fd, rs) : -1;
+
+    // A cached path that vanished: forget it and search PATH again
+    if (pid < 0 && path && errno == ENOENT && path != argv[0]) {
+        cmd_hash_forget(&sh->cmd_hash, argv[0]);
+        path = cmd_hash_lookup(&sh->cmd_hash, argv[0]);
+        pid = path ? spawn_cmd(path, argv, pgid, tty, in_fd, out_fd, rs) : -1;
+    }
+
+    if (pid < 0) {
+        if (path) {
+            perror(argv[0]);
+        } else {
+            fprintf(stderr, "%s: command not found\n", argv[0]);
+        }
+    }
+    return pid;
+}
+
+// A builtin stage writing into a pipe, and the job that reads from it
+struct stage_wait {
+    struct shell *sh;
+    struct job *job;
+};
+
+// Waits until a pipe written by an in-shell builtin stage has room. The
+// shell must never block in that write: once the reader is stopped (^Z),
+// nothing would drain the pipe and the prompt would never come back. So the
+// pipe is polled along with SIGCHLD, the job is reaped as it changes state,
+// and the output is given up as soon as any of its processes stops. A
+// reader that exits shows up as POLLERR, and the retried write gets EPIPE.
+static bool wait_stage_room(void *ctx, int fd) {
+    struct stage_wait *w = ctx;
+    struct pollfd fds[2] = {
+        { .fd = fd, .events = POLLOUT },
+        { .fd = w->sh->sigchld_fd, .events = POLLIN },
+    };
+    int timeout = w->sh->sigchld_fd >= 0 ? -1 : STAGE_POLL_MS;
+    for (;;) {
+        // Draining SIGCHLD first lets the poll sleep until the next change
+        sh_reap(w->sh);
+        job_reap(w->job);
+        if (w->job->state == JOB_STOPPED) return false;
+
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready > 0 && fds[0].revents) return true;
+    }
+}
+
+// Runs an output-only builtin inside the shell. It writes to its stdout, or
+// when out_fd is not -1 into that non-blocking pipe end, which job reads.
+static int run_builtin_stage(struct shell *sh, char **argv, int out_fd, struct job *job) {
+    struct sink out;
+    struct stage_wait w = { .sh = sh, .job = job };
+    if (out_fd < 0) {
+        fflush(stdout);
+        sink_init(&out, STDOUT_FILENO);
+    } else {
+        sink_init(&out, out_fd);
+        sink_set_wait(&out, wait_stage_room, &w);
+    }
+    bool ok = do_builtin_sink(sh, argv, &out);
+    sink_flush(&out);
+    return ok ? 0 : 1;
+}
+
+// Runs a lone builtin, a { } group, or a command that is only redirections
+// inside the shell. Redirections are applied in place and the shell's own
+// descriptors are put back afterwards, so no process is needed.
+static int run_in_shell(struct shell *sh, const struct command *cmd) {
+    if (cmd->nredirs == 0) return run_here(sh, cmd);
+
+    struct redirs rs;
+    if (redir_open(&rs, cmd->redirs, cmd->nredirs, &sh->arena) != 0) return 1;
+    int status = 0;
+    if (cmd->argv[0] || cmd->body) {
+        fflush(stdout);
+        int *saved = redir_save(&rs, &sh->arena);
+        status = 1;
+        if (saved) {
+            if (redir_apply(&rs) == 0) status = run_here(sh, cmd);
+            fflush(stdout);
+            redir_restore(&rs, saved);
+        }
+    }
+    redir_close(&rs);
+    return status;
+}
+
+int wait_foreground(struct shell *sh, struct job *j) {
+    bool job_control = sh->shell_is_interactive;
+    int tty = job_control ? sh->shell_terminal : -1;
+    if (tty >= 0) tcsetpgrp(tty, j->pgid);
+
+    size_t next = 0;
+    while (j->state == JOB_RUNNING) {
+        int st;
+        pid_t w;
+        struct rusage ru;
+        // wait4 also hands back what each process cost, for 'time'
+        uint64_t t0 = shstat_now();
+        if (job_control) {
+            w = wait4(-j->pgid, &st, WUNTRACED, &ru);
+        } else {
+            // Without job control the children share the shell's group, so
+            // wait for them one by one rather than by group
+            while (j->procs[next].done) next++;
+            w = wait4(j->procs[next].pid, &st, 0, &ru);
+        }
+        shstat_add(&sh->stats, STAT_WAIT, t0);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            // st was never filled in, so there is nothing to explain
+            perror("wait4");
+            break;
+        }
+        if (job_update(j, w, st)) {
+            rusage_add(&j->usage, &ru);
+            rusage_add(&sh->fg_usage, &ru);
+        }
+    }
+
+    // Restore control to the shell after the job ends or stops
+    if (tty >= 0) tcsetpgrp(tty, sh->shell_pgid);
+
+    int status = job_status(j);
+    if (j->state == JOB_STOPPED) {
+        // Handle stopped job (Ctrl+Z): keep it in the table for fg/bg
+        if (j->id == 0) j = jobs_add(&sh->jobs, j);
+        if (j) {
+            struct sink err;
+            sink_init(&err, STDERR_FILENO);
+            sink_write(&err, "\n", 1);
+            j->notify = false;
+            jobs_print(&sh->jobs, j, &err);
+            sink_flush(&err);
+        }
+    } else if (j->id != 0) {
+        jobs_remove(&sh->jobs, j);
+    }
+    return status;
+}
+
+// Starts a pipeline and, in the foreground, waits for it. usage receives
+// what the pipeline's processes cost.
+static int launch_pipeline(struct shell *sh, const struct pipeline *pl,
+                           struct rusage *usage) {
+    bool fg = !pl->background;
+
+    // A lone builtin or { } group runs in the shell itself so it can change
+    // shell state
+    const struct command *only = &pl->stages[0];
+    if (fg && pl->nstages == 1 && !only->subshell
+        && (only->body || !only->argv[0] || is_builtin(only->argv[0]))) {
+        // Whatever the group waits for is its cost; nested totals still
+        // see it afterwards
+        struct rusage outer = sh->fg_usage;
+        memset(&sh->fg_usage, 0, sizeof(sh->fg_usage));
+        int status = run_in_shell(sh, only);
+        *usage = sh->fg_usage;
+        sh->fg_usage = outer;
+        rusage_add(&sh->fg_usage, usage);
+        return status;
+    }
+
+    // Only an interactive shell does job control; background jobs and
+    // scripts never get the terminal
+    bool job_control = sh->shell_is_interactive;
+    int tty = fg && job_control ? sh->shell_terminal : -1;
+    pid_t pgid = 0;
+    int in_fd = -1;
+
+    struct job job = {
+        .state = JOB_RUNNING,
+        .procs = arena_alloc(&sh->arena, pl->nstages * sizeof(struct job_proc)),
+        .cmd = arena_strndup(&sh->arena, pl->text, pl->textlen),
+    };
+
+    // In the foreground, output-only builtin stages run in the shell once
+    // every process is up; out_fds[i] is the write end they keep, -1 for the
+    // shell's stdout
+    int *out_fds = arena_alloc(&sh->arena, pl->nstages * sizeof(int));
+    if (!job.procs || !job.cmd || !out_fds) return 1;
+    for (size_t i = 0; i < pl->nstages; i++) out_fds[i] = -2;
+
+    // A command reading the shell's stdin starts right after the current line
+    input_sync(&sh->input);
+
+    // Start every stage before waiting on any of them so they run concurrently
+    bool last_started = false;
+    int status = 127;
+    for (size_t i = 0; i < pl->nstages; i++) {
+        const struct command *cmd = &pl->stages[i];
+        char **argv = cmd->argv;
+        int pfd[2] = { -1, -1 };
+        if (i + 1 < pl->nstages && pipe2(pfd, O_CLOEXEC) < 0) {
+            perror("pipe");
+            break;
+        }
+
+        if (fg && argv[0] && cmd->nredirs == 0 && builtin_in_pipeline(argv[0])) {
+            // Builtins never read stdin; closing it lets the writer see EPIPE
+            if (in_fd >= 0) close(in_fd);
+            // The shell must not block on a full pipe: see wait_stage_room
+            if (pfd[1] >= 0) fcntl(pfd[1], F_SETFL, O_NONBLOCK);
+            out_fds[i] = pfd[1];
+            in_fd = pfd[0];
+            continue;
+        }
+
+        // The first stage that starts leads the group and takes the terminal.
+        // A stage whose redirections fail, or that is only redirections,
+        // starts nothing.
+        int stage_tty = pgid == 0 ? tty : -1;
+        pid_t stage_pgid = job_control ? pgid : -1;
+        struct redirs rs;
+        bool opened = redir_open(&rs, cmd->redirs, cmd->nredirs, &sh->arena) == 0;
+        pid_t pid = -1;
+        if (opened && (argv[0] || cmd->body)) {
+            uint64_t t0 = shstat_now();
+            pid = cmd->body || is_builtin(argv[0])
+                ? launch_forked(sh, cmd, stage_pgid, stage_tty, in_fd, pfd[1], pfd[0], &rs)
+                : launch_external(sh, argv, stage_pgid, stage_tty, in_fd, pfd[1], &rs);
+            shstat_add(&sh->stats, pid < 0 ? STAT_EXEC_FAIL : STAT_SPAWN, t0);
+        }
+
+        // The children hold their own copies of the pipe ends and files now
+        if (opened) redir_close(&rs);
+        if (in_fd >= 0) close(in_fd);
+        if (pfd[1] >= 0) close(pfd[1]);
+        in_fd = pfd[0];
+
+        if (pid < 0) {
+            if (i + 1 == pl->nstages) status = !opened ? 1 : argv[0] || cmd->body ? 127 : 0;
+            continue;
+        }
+        if (pgid == 0) pgid = pid;
+        if (job_control) setpgid(pid, pgid);
+        job.procs[job.nprocs++] = (struct job_proc){ .pid = pid };
+        if (i + 1 == pl->nstages) last_started = true;
+    }
+    if (in_fd >= 0) close(in_fd);
+    job.pgid = pgid;
+
+    if (!fg) {
+        if (job.nprocs == 0) return 127;
+        struct job *j = jobs_add(&sh->jobs, &job);
+        if (j && job_control) fprintf(stderr, "[%d] %d\n", j->id, (int)j->pgid);
+        return 0;
+    }
+
+    // Repeat what the child already did so there is no window where the
+    // shell waits on a job that does not own the terminal
+    if (tty >= 0 && pgid) tcsetpgrp(tty, pgid);
+
+    for (size_t i = 0; i < pl->nstages; i++) {
+        if (out_fds[i] == -2) continue;
+        int rval = run_builtin_stage(sh, pl->stages[i].argv, out_fds[i], &job);
+        if (out_fds[i] >= 0) close(out_fds[i]);
+        if (i + 1 == pl->nstages) status = rval;
+    }
+
+    if (job.nprocs > 0) {
+        int job_st = wait_foreground(sh, &job);
+        if (last_started) status = job_st;
+        *usage = job.usage;
+    } else if (tty >= 0 && pgid) {
+        tcsetpgrp(tty, sh->shell_pgid);
+    }
+    return status;
+}
+
+int exec_pipeline(struct shell *sh, const struct pipeline *pl) {
+    // Background jobs are not timed; the prompt returns right away
+    bool timed = pl->timed && !pl->background;
+    if (!timed && (sh->time_threshold_ms < 0 || pl->background)) {
+        struct rusage usage;
+        return pl->nstages ? launch_pipeline(sh, pl, &usage) : 0;
+    }
+
+    struct cmd_timer timer;
+    struct rusage usage = {0};
+    timer_start(&timer);
+    int status = pl->nstages ? launch_pipeline(sh, pl, &usage) : 0;
+
+    struct cmd_times t;
+    timer_stop(&timer, &usage, &t);
+    bool slow = sh->time_threshold_ms >= 0 && t.real * 1000 >= sh->time_threshold_ms;
+    if (timed || slow) {
+        struct sink err;
+        fflush(stdout);
+        sink_init(&err, STDERR_FILENO);
+        if (!timed) {
+            sink_printf(&err, "\nslow command (%.0f ms): %.*s", t.real * 1000,
+                        (int)pl->textlen, pl->text);
+        }
+        times_print(&t, &err);
+        sink_flush(&err);
+    }
+    return status;
+}
+
+// An interactive shell drops the rest of a list once the user interrupts
+// a command in it
+static bool interrupted(const struct shell *sh, int status) {
+    return sh->shell_is_interactive && status == 128 + SIGINT;
+}
+
+int exec_node(struct shell *sh, const struct node *n) {
+    if (n->kind == NODE_PIPELINE) {
+        sh->last_status = exec_pipeline(sh, n->pl);
+        return sh->last_status;
+    }
+
+    int status = exec_node(sh, n->left);
+    if (interrupted(sh, status)) return status;
+    if (n->kind == NODE_AND && status != 0) return status;
+    if (n->kind == NODE_OR && status == 0) return status;
+    return exec_node(sh, n->right);
+}
@@ -0,0 +1,61 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <stddef.h>
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct shell;
+struct job;
+
+/**
+ * @brief Run a pipeline. A lone foreground builtin runs inside the shell,
+ * with any redirections applied to the shell's descriptors and undone
+ * afterwards. Otherwise every stage is started up front in one process
+ * group, connected with close-on-exec pipes; each stage's redirections are
+ * opened by the shell and dup2'd into place by the child after the pipes.
+ * A foreground pipeline is waited for as a whole; a background one is added
+ * to the job table and left running. A foreground pipeline marked with
+ * 'time', or one that runs longer than sh->time_threshold_ms, has its times
+ * reported on stderr.
+ *
+ * @param sh The shell instance
+ * @param pl The pipeline to run
+ * @return The exit status of the last stage, or 128+signal if it was killed
+ * or stopped; 0 for a background pipeline that started
+ */
+int exec_pipeline(struct shell *sh, const struct pipeline *pl);
+
+/**
+ * @brief Run a command list. '&&' and '||' run their right side only when
+ * the left one succeeded or failed; ';' and '&' always go on, except that
+ * an interactive shell abandons the rest of the list when a foreground
+ * command is killed by SIGINT, as bash does. Every pipeline's status is
+ * stored in sh->last_status as it finishes.
+ *
+ * @param sh The shell instance
+ * @param n The root of the list
+ * @return The status of the last pipeline run
+ */
+int exec_node(struct shell *sh, const struct node *n);
+
+/**
+ * @brief Give a job the terminal and wait until it finishes or stops. A job
+ * that stops is added to the job table (if it is not already there) and
+ * reported; a job from the table that finishes is removed from it.
+ *
+ * @param sh The shell instance
+ * @param j The job to wait for
+ * @return The job's exit status in the $? convention
+ */
+int wait_foreground(struct shell *sh, struct job *j);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
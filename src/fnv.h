@@ -0,0 +1,34 @@
+#ifndef FNV_H
+#define FNV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief 64-bit FNV-1a hash of len bytes: one multiply per byte, no setup,
+ * and good enough spread for the shell's small hash tables. Shared by the
+ * command hash, the history store and the parse cache.
+ *
+ * @param s The bytes
+ * @param len Number of bytes
+ * @return The hash
+ */
+static inline uint64_t fnv1a(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "heredoc.h"
+#include "sink.h"
+
+// Collects one body. It is buffered until it outgrows a pipe's atomic
+// write, at which point a memfd is created and the sink starts flushing
+// into it.
+struct body {
+    struct sink out;    // fd is -1 while the body may still fit a pipe
+    size_t len;
+};
+
+static int body_switch_to_memfd(struct body *b) {
+    int fd = memfd_create("here-document", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    b->out.fd = fd;
+    return 0;
+}
+
+static int body_add(struct body *b, const char *p, size_t n, bool ref) {
+    if (b->out.fd < 0 && (b->len + n > PIPE_BUF || b->out.niov >= SINK_IOVMAX - 1)
+        && body_switch_to_memfd(b) != 0) {
+        return -1;
+    }
+    if (ref) {
+        sink_write_ref(&b->out, p, n);
+    } else {
+        sink_write(&b->out, p, n);
+    }
+    b->len += n;
+    return 0;
+}
+
+// Hands back a descriptor positioned at the start of the body
+static int body_finish(struct body *b) {
+    if (b->out.fd >= 0) {
+        int fd = b->out.fd;
+        if (sink_flush(&b->out) != 0 || lseek(fd, 0, SEEK_SET) < 0) {
+            int err = b->out.error ? b->out.error : errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+
+    // Small enough that writing it all into a pipe cannot block
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) return -1;
+    b->out.fd = p[1];
+    int rval = sink_flush(&b->out);
+    int err = b->out.error;
+    close(p[1]);
+    if (rval != 0) {
+        close(p[0]);
+        errno = err;
+        return -1;
+    }
+    return p[0];
+}
+
+// Reads lines up to the delimiter into a new body descriptor
+static int read_body(const struct redir *r, struct input *in, const char *prompt) {
+    struct body b = { .len = 0 };
+    sink_init(&b.out, -1);
+
+    // Only a mapping outlives the next input_next, so only its lines can
+    // be queued by reference; adjacent ones merge into a single segment
+    bool mapped = in->kind == INPUT_MMAP;
+    for (;;) {
+        size_t len;
+        const char *line = input_next(in, prompt, &len);
+        if (!line) {
+            fprintf(stderr, "warning: here-document delimited by end-of-file (wanted `%s')\n",
+                    r->word);
+            break;
+        }
+        if (r->strip_tabs) {
+            while (len > 0 && *line == '\t') {
+                line++;
+                len--;
+            }
+        }
+        if (len == r->len && memcmp(line, r->word, len) == 0) break;
+
+        int rval;
+        if (mapped && line + len < in->buf + in->end) {
+            rval = body_add(&b, line, len + 1, true);
+        } else {
+            rval = body_add(&b, line, len, false);
+            if (rval == 0) rval = body_add(&b, "\n", 1, false);
+        }
+        if (rval != 0) {
+            if (b.out.fd >= 0) close(b.out.fd);
+            return -1;
+        }
+    }
+    return body_finish(&b);
+}
+
+// Reads the bodies of one pipeline's here-documents, nested ones included,
+// in the order they appear on the line
+static int read_pipeline(struct pipeline *pl, struct input *in, const char *prompt,
+                         struct arena *arena) {
+    const char *text = arena_strndup(arena, pl->text, pl->textlen);
+    if (!text) return -1;
+    pl->text = text;
+
+    for (size_t i = 0; i < pl->nstages; i++) {
+        struct command *cmd = &pl->stages[i];
+        if (cmd->body && heredoc_read(cmd->body, in, prompt, arena) != 0) return -1;
+        for (size_t k = 0; pl->nheredocs && k < cmd->nredirs; k++) {
+            struct redir *r = &cmd->redirs[k];
+            if (r->kind != REDIR_HEREDOC) continue;
+            r->here_fd = read_body(r, in, prompt);
+            if (r->here_fd < 0) {
+                perror("here-document");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int heredoc_read(struct node *n, struct input *in, const char *prompt,
+                 struct arena *arena) {
+    if (n->kind == NODE_PIPELINE) return read_pipeline(n->pl, in, prompt, arena);
+    if (heredoc_read(n->left, in, prompt, arena) != 0) return -1;
+    return heredoc_read(n->right, in, prompt, arena);
+}
+
+void heredoc_close(struct node *n) {
+    if (n->nheredocs == 0) return;
+    if (n->kind != NODE_PIPELINE) {
+        heredoc_close(n->left);
+        heredoc_close(n->right);
+        return;
+    }
+    struct pipeline *pl = n->pl;
+    for (size_t i = 0; i < pl->nstages; i++) {
+        struct command *cmd = &pl->stages[i];
+        if (cmd->body) heredoc_close(cmd->body);
+        for (size_t k = 0; k < cmd->nredirs; k++) {
+            struct redir *r = &cmd->redirs[k];
+            if (r->kind != REDIR_HEREDOC || r->here_fd < 0) continue;
+            close(r->here_fd);
+            r->here_fd = -1;
+        }
+    }
+}
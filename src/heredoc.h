@@ -0,0 +1,49 @@
+#ifndef HEREDOC_H
+#define HEREDOC_H
+
+#include "arena.h"
+#include "input.h"
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Prompt for here-document lines read interactively, like bash's PS2 */
+#define HEREDOC_PROMPT "> "
+
+/**
+ * @brief Read the body of each here-document in a command list, in the
+ * order they appear, from the lines that follow it, each up to a line
+ * equal to its delimiter.
+ * Nothing touches the disk: a body that fits in PIPE_BUF goes into a pipe,
+ * anything larger is streamed into a memfd as it is read, so a multi-MB
+ * body is never held in the shell's memory. Lines of a mapped script are
+ * written straight from the mapping.
+ *
+ * Reading moves the input past the command's own line, so the text of
+ * every pipeline is first copied into the arena.
+ *
+ * @param n The list; each here-document's here_fd is filled in
+ * @param in Where the command line came from
+ * @param prompt Prompt for readline, or NULL
+ * @param arena The arena the pipeline was parsed into
+ * @return 0 on success, -1 if a body could not be stored (reported on
+ * stderr). Input that ends before the delimiter only gets a warning.
+ */
+int heredoc_read(struct node *n, struct input *in, const char *prompt,
+                 struct arena *arena);
+
+/**
+ * @brief Close the bodies heredoc_read opened.
+ *
+ * @param n The list
+ */
+void heredoc_close(struct node *n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
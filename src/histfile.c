@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "histfile.h"
+
+// Offset where the last n lines of p[0, len) begin, found by stepping back
+// one newline at a time; nothing before that point is read
+static size_t tail_start(const char *p, size_t len, size_t n) {
+    if (n == 0) return len;
+    // The final newline ends the last line rather than starting a new one
+    size_t pos = len > 0 && p[len - 1] == '\n' ? len - 1 : len;
+    while (n-- > 0) {
+        const char *nl = memrchr(p, '\n', pos);
+        if (!nl) return 0;
+        pos = (size_t)(nl - p);
+    }
+    return pos + 1;
+}
+
+int histfile_open(struct histfile *hf, const char *path) {
+    hf->fd = -1;
+    hf->path = NULL;
+    if (!path || !*path) return 0;
+
+    hf->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (hf->fd < 0) return -1;
+    hf->path = strdup(path);
+    if (!hf->path) {
+        histfile_close(hf);
+        return -1;
+    }
+    return 0;
+}
+
+void histfile_trim_background(const struct histfile *hf, long maxlines) {
+    // Every line takes at least one byte, so a file no bigger than maxlines
+    // bytes cannot be too long and needs no scan at all
+    struct stat st;
+    if (hf->fd < 0 || maxlines < 0 || fstat(hf->fd, &st) != 0 || st.st_size <= maxlines) {
+        return;
+    }
+
+    // The trimmer is a grandchild, so init reaps it and the shell, which
+    // only waits for its jobs, never sees it
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (fork() == 0) _exit(histfile_trim(hf->path, (size_t)maxlines) == 0 ? 0 : 1);
+        _exit(0);
+    }
+    if (pid > 0) {
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+    }
+}
+
+size_t histfile_load(const struct histfile *hf, size_t n,
+                     void (*add)(void *ctx, const char *line), void *ctx) {
+    if (!hf->path) return 0;
+    int fd = open(hf->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    // A shared lock holds off any shell truncating the file while it is
+    // mapped, and the size is only taken once the lock is ours; a file cut
+    // short under the mapping would raise SIGBUS
+    struct stat st;
+    char *map = MAP_FAILED;
+    if (flock(fd, LOCK_SH) == 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+
+    size_t len = (size_t)st.st_size;
+    size_t added = 0;
+    char buf[1024];
+    for (size_t pos = tail_start(map, len, n); pos < len;) {
+        const char *line = map + pos;
+        const char *nl = memchr(line, '\n', len - pos);
+        size_t llen = nl ? (size_t)(nl - line) : len - pos;
+        pos += llen + 1;
+        if (llen == 0) continue;
+
+        // The mapping is read-only, so terminate a copy of the line
+        char *s = llen < sizeof(buf) ? buf : malloc(llen + 1);
+        if (!s) break;
+        memcpy(s, line, llen);
+        s[llen] = '\0';
+        add(ctx, s);
+        if (s != buf) free(s);
+        added++;
+    }
+    munmap(map, len);
+    close(fd);  // Also drops the lock
+    return added;
+}
+
+int histfile_append(const struct histfile *hf, const char *line, size_t len) {
+    if (hf->fd < 0) return 0;
+    struct iovec iov[2] = {
+        { .iov_base = (void *)line, .iov_len = len },
+        { .iov_base = "\n", .iov_len = 1 },
+    };
+    flock(hf->fd, LOCK_SH);
+    ssize_t n = writev(hf->fd, iov, 2);
+    flock(hf->fd, LOCK_UN);
+    return n == (ssize_t)(len + 1) ? 0 : -1;
+}
+
+int histfile_trim(const char *path, size_t maxlines) {
+    // A descriptor of our own: flock locks belong to the open file, and the
+    // shell's append descriptor must not share this one's exclusive lock
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    int rc = -1;
+    struct stat st;
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &st) != 0) goto out;
+    if (st.st_size == 0) {
+        rc = 0;
+        goto out;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) goto out;
+    size_t start = tail_start(map, len, maxlines);
+    if (start > 0) memmove(map, map + start, len - start);
+    munmap(map, len);
+    rc = start > 0 ? ftruncate(fd, (off_t)(len - start)) : 0;
+
+out:
+    close(fd);  // Also drops the lock
+    return rc;
+}
+
+void histfile_close(struct histfile *hf) {
+    if (hf->fd >= 0) close(hf->fd);
+    hf->fd = -1;
+    free(hf->path);
+    hf->path = NULL;
+}
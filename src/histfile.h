@@ -0,0 +1,93 @@
+#ifndef HISTFILE_H
+#define HISTFILE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Lines kept in memory and in the file when HISTSIZE or HISTFILESIZE is
+ * unset, as in bash */
+#define HISTFILE_DEFAULT_SIZE 500
+
+/* History file used when HISTFILE is unset, relative to $HOME */
+#define HISTFILE_DEFAULT_NAME ".lab_history"
+
+/* The history file of an interactive shell */
+struct histfile {
+    int fd;             // Opened O_APPEND, -1 when history is not saved
+    char *path;
+};
+
+/**
+ * @brief Open the history file for appending, creating it if needed.
+ *
+ * @param hf The history file
+ * @param path The file, or NULL to disable saving
+ * @return 0 on success, -1 with errno set if the file could not be opened
+ */
+int histfile_open(struct histfile *hf, const char *path);
+
+/**
+ * @brief If the history file may hold more than maxlines lines, start a
+ * process that cuts it down to its last maxlines lines with histfile_trim,
+ * so a long file never delays startup. Call this after histfile_load.
+ *
+ * @param hf The history file
+ * @param maxlines Lines to keep in the file, or -1 to never truncate it
+ */
+void histfile_trim_background(const struct histfile *hf, long maxlines);
+
+/**
+ * @brief Pass the last n lines of the history file to add, oldest first.
+ * The file is mapped and only scanned backwards from the end as far as
+ * those lines go, so loading costs the same for a 500-line file and a
+ * 500k-line one. Empty lines are skipped. The file is read under a shared
+ * flock, so a concurrent histfile_trim waits until the load is done.
+ *
+ * @param hf The history file
+ * @param n Number of lines wanted
+ * @param add Called with each line, which is NUL-terminated
+ * @param ctx Passed to add
+ * @return Number of lines passed to add
+ */
+size_t histfile_load(const struct histfile *hf, size_t n,
+                     void (*add)(void *ctx, const char *line), void *ctx);
+
+/**
+ * @brief Append one entry. The line and its newline go out in a single
+ * O_APPEND write, so concurrent shells never interleave partial lines. A
+ * shared flock keeps the append out of the way of a running truncation.
+ *
+ * @param hf The history file
+ * @param line The entry
+ * @param len Length of line
+ * @return 0 on success or when history is not saved, -1 on error
+ */
+int histfile_append(const struct histfile *hf, const char *line, size_t len);
+
+/**
+ * @brief Cut the file at path down to its last maxlines lines in place,
+ * under an exclusive flock. histfile_trim_background runs this in the
+ * background.
+ *
+ * @param path The history file
+ * @param maxlines Lines to keep
+ * @return 0 on success, -1 with errno set on error
+ */
+int histfile_trim(const char *path, size_t maxlines);
+
+/**
+ * @brief Close the file and release the path.
+ *
+ * @param hf The history file
+ */
+void histfile_close(struct histfile *hf);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
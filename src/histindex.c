@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "histindex.h"
+#include "fnv.h"
+
+/* Initial size of the intern and trigram tables; powers of two */
+#define HISTINDEX_MIN_SLOTS 1024
+
+/* Most posting lists a query intersects; more trigrams add little */
+#define HISTINDEX_MAX_TERMS 16
+
+static uint32_t trigram(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return ((uint32_t)u[0] << 16 | (uint32_t)u[1] << 8 | u[2]) + 1;
+}
+
+static size_t slot_of(uint32_t key, size_t nslots) {
+    return (key * 2654435761u) & (nslots - 1);
+}
+
+// Strings keep a 32-bit hash; both halves of the 64-bit one feed it
+static uint32_t hash_line(const char *s, size_t len) {
+    uint64_t h = fnv1a(s, len);
+    return (uint32_t)(h ^ h >> 32);
+}
+
+unsigned histcontrol_parse(const char *s) {
+    unsigned control = 0;
+    while (s && *s) {
+        size_t n = strcspn(s, ":");
+        if (n == 10 && strncmp(s, "ignoredups", n) == 0) control |= HISTCONTROL_IGNOREDUPS;
+        if (n == 10 && strncmp(s, "ignoreboth", n) == 0) control |= HISTCONTROL_IGNOREDUPS;
+        if (n == 9 && strncmp(s, "erasedups", n) == 0) control |= HISTCONTROL_ERASEDUPS;
+        s += n;
+        if (*s == ':') s++;
+    }
+    return control;
+}
+
+void histindex_init(struct histindex *ix, unsigned control) {
+    memset(ix, 0, sizeof(*ix));
+    ix->control = control;
+}
+
+void histindex_destroy(struct histindex *ix) {
+    for (size_t i = 0; i < ix->nslots; i++) free(ix->slots[i].ids);
+    free(ix->slots);
+    free(ix->interned);
+    free(ix->entries);
+    free(ix->strs);
+    free(ix->pool);
+    histindex_init(ix, ix->control);
+}
+
+// Returns arr grown to hold at least n elements of size sz, updating *cap,
+// or NULL (leaving arr alone) if memory ran out
+static void *reserve(void *arr, size_t *cap, size_t n, size_t sz, size_t first) {
+    if (n <= *cap) return arr;
+    size_t c = *cap ? *cap : first;
+    while (c < n) c *= 2;
+    void *q = realloc(arr, c * sz);
+    if (q) *cap = c;
+    return q;
+}
+
+// Rebuilds the intern table at twice the size
+static int intern_grow(struct histindex *ix) {
+    size_t n = ix->ninterned ? ix->ninterned * 2 : HISTINDEX_MIN_SLOTS;
+    uint32_t *t = calloc(n, sizeof(*t));
+    if (!t) return -1;
+    for (size_t id = 0; id < ix->nstrs; id++) {
+        size_t j = slot_of(ix->strs[id].hash, n);
+        while (t[j]) j = (j + 1) & (n - 1);
+        t[j] = (uint32_t)id + 1;
+    }
+    free(ix->interned);
+    ix->interned = t;
+    ix->ninterned = n;
+    return 0;
+}
+
+// Id of the string equal to line, adding it to the pool if it is new
+static int64_t intern(struct histindex *ix, const char *line, size_t len) {
+    uint32_t h = hash_line(line, len);
+    if (ix->ninterned) {
+        for (size_t i = slot_of(h, ix->ninterned); ix->interned[i];
+             i = (i + 1) & (ix->ninterned - 1)) {
+            const struct hist_str *s = &ix->strs[ix->interned[i] - 1];
+            if (s->hash == h && s->len == len && memcmp(ix->pool + s->off, line, len) == 0) {
+                return ix->interned[i] - 1;
+            }
+        }
+    }
+
+    if ((ix->nstrs + 1) * 10 > ix->ninterned * 7 && intern_grow(ix) != 0) return -1;
+    struct hist_str *strs = reserve(ix->strs, &ix->strs_cap, ix->nstrs + 1,
+                                    sizeof(*strs), 256);
+    if (!strs) return -1;
+    ix->strs = strs;
+    char *pool = reserve(ix->pool, &ix->pool_cap, ix->pool_len + len + 1, 1, 64 * 1024);
+    if (!pool) return -1;
+    ix->pool = pool;
+    uint32_t id = (uint32_t)ix->nstrs++;
+    ix->strs[id] = (struct hist_str){ (uint32_t)ix->pool_len, (uint32_t)len, h, 0 };
+    memcpy(ix->pool + ix->pool_len, line, len);
+    ix->pool[ix->pool_len + len] = '\0';
+    ix->pool_len += len + 1;
+
+    size_t i = slot_of(h, ix->ninterned);
+    while (ix->interned[i]) i = (i + 1) & (ix->ninterned - 1);
+    ix->interned[i] = id + 1;
+    return id;
+}
+
+int histindex_add(struct histindex *ix, const char *line, size_t len) {
+    int64_t sid = intern(ix, line, len);
+    if (sid < 0) return -1;
+    struct hist_str *s = &ix->strs[sid];
+
+    if (ix->control & HISTCONTROL_IGNOREDUPS) {
+        size_t last = ix->nentries;
+        while (last > 0 && ix->entries[last - 1] == HISTINDEX_ERASED) last--;
+        if (last > 0 && ix->entries[last - 1] == sid) return 0;
+    }
+    if ((ix->control & HISTCONTROL_ERASEDUPS) && s->refs > 0) {
+        for (size_t i = ix->nentries; i-- > 0 && s->refs > 0;) {
+            if (ix->entries[i] != sid) continue;
+            ix->entries[i] = HISTINDEX_ERASED;
+            s->refs--;
+            ix->live--;
+        }
+    }
+
+    uint32_t *entries = reserve(ix->entries, &ix->entries_cap, ix->nentries + 1,
+                                sizeof(*entries), 256);
+    if (!entries) return -1;
+    ix->entries = entries;
+    ix->entries[ix->nentries++] = (uint32_t)sid;
+    s->refs++;
+    ix->live++;
+    return 1;
+}
+
+const char *histindex_text(const struct histindex *ix, size_t id, size_t *len) {
+    if (id >= ix->nentries || ix->entries[id] == HISTINDEX_ERASED) return NULL;
+    const struct hist_str *s = &ix->strs[ix->entries[id]];
+    if (len) *len = s->len;
+    return ix->pool + s->off;
+}
+
+static struct posting *find(const struct histindex *ix, uint32_t key) {
+    if (!ix->nslots) return NULL;
+    for (size_t i = slot_of(key, ix->nslots);; i = (i + 1) & (ix->nslots - 1)) {
+        if (ix->slots[i].key == key) return &ix->slots[i];
+        if (ix->slots[i].key == 0) return NULL;
+    }
+}
+
+// Doubles the trigram table, keeping it under 70% full
+static int grow(struct histindex *ix) {
+    size_t n = ix->nslots ? ix->nslots * 2 : HISTINDEX_MIN_SLOTS;
+    struct posting *slots = calloc(n, sizeof(*slots));
+    if (!slots) return -1;
+    for (size_t i = 0; i < ix->nslots; i++) {
+        if (!ix->slots[i].key) continue;
+        size_t j = slot_of(ix->slots[i].key, n);
+        while (slots[j].key) j = (j + 1) & (n - 1);
+        slots[j] = ix->slots[i];
+    }
+    free(ix->slots);
+    ix->slots = slots;
+    ix->nslots = n;
+    return 0;
+}
+
+static struct posting *find_or_add(struct histindex *ix, uint32_t key) {
+    struct posting *p = find(ix, key);
+    if (p) return p;
+    if ((ix->used + 1) * 10 > ix->nslots * 7 && grow(ix) != 0) return NULL;
+    size_t i = slot_of(key, ix->nslots);
+    while (ix->slots[i].key) i = (i + 1) & (ix->nslots - 1);
+    ix->slots[i].key = key;
+    ix->used++;
+    return &ix->slots[i];
+}
+
+// Adds every trigram of one string to the table
+static int index_str(struct histindex *ix, uint32_t sid) {
+    const char *text = ix->pool + ix->strs[sid].off;
+    size_t len = ix->strs[sid].len;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        struct posting *p = find_or_add(ix, trigram(text + i));
+        if (!p) return -1;
+        // A trigram repeated within the line is listed once
+        if (p->n && p->ids[p->n - 1] == sid) continue;
+        if (p->n == p->cap) {
+            uint32_t cap = p->cap ? p->cap * 2 : 4;
+            uint32_t *ids = realloc(p->ids, cap * sizeof(*ids));
+            if (!ids) return -1;
+            p->ids = ids;
+            p->cap = cap;
+        }
+        p->ids[p->n++] = sid;
+    }
+    return 0;
+}
+
+size_t histindex_catch_up(struct histindex *ix, size_t max) {
+    while (max-- > 0 && ix->indexed < ix->nstrs) {
+        if (index_str(ix, (uint32_t)ix->indexed) != 0) break;
+        ix->indexed++;
+    }
+    return ix->nstrs - ix->indexed;
+}
+
+// Whether posting list p holds sid
+static bool contains(const struct posting *p, uint32_t sid) {
+    size_t lo = 0, hi = p->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (p->ids[mid] < sid) lo = mid + 1; else hi = mid;
+    }
+    return lo < p->n && p->ids[lo] == sid;
+}
+
+static int by_length(const void *a, const void *b) {
+    const struct posting *x = *(const struct posting *const *)a;
+    const struct posting *y = *(const struct posting *const *)b;
+    return (x->n > y->n) - (x->n < y->n);
+}
+
+static bool str_matches(const struct histindex *ix, uint32_t sid, const char *pat, size_t plen) {
+    const struct hist_str *s = &ix->strs[sid];
+    return plen == 0 || (s->len >= plen && memmem(ix->pool + s->off, s->len, pat, plen));
+}
+
+// Marks in hits every indexed string that contains pat. Returns false when
+// some trigram of pat occurs nowhere, so nothing indexed can match.
+static bool mark_matches(const struct histindex *ix, const char *pat, size_t plen,
+                         unsigned char *hits) {
+    // Trigrams spread across the pattern
+    const struct posting *terms[HISTINDEX_MAX_TERMS];
+    size_t nterms = plen - 2;
+    size_t step = (nterms + HISTINDEX_MAX_TERMS - 1) / HISTINDEX_MAX_TERMS;
+    size_t nt = 0;
+    for (size_t i = 0; i < nterms; i += step) {
+        const struct posting *p = find(ix, trigram(pat + i));
+        if (!p) return false;
+        terms[nt++] = p;
+    }
+    qsort(terms, nt, sizeof(terms[0]), by_length);
+
+    // Walk the shortest list; the others are probed by binary search, and
+    // only survivors are compared byte by byte
+    const struct posting *shortest = terms[0];
+    for (size_t k = 0; k < shortest->n; k++) {
+        uint32_t sid = shortest->ids[k];
+        size_t t = 1;
+        while (t < nt && contains(terms[t], sid)) t++;
+        if (t == nt && str_matches(ix, sid, pat, plen)) hits[sid / 8] |= 1u << (sid % 8);
+    }
+    return true;
+}
+
+size_t histindex_search(struct histindex *ix, const char *pat, size_t plen,
+                        size_t before, size_t *ids, size_t max) {
+    if (before > ix->nentries) before = ix->nentries;
+    size_t found = 0;
+
+    // Short patterns have no trigrams: compare every entry
+    if (plen < 3) {
+        for (size_t id = before; id-- > 0 && found < max;) {
+            uint32_t sid = ix->entries[id];
+            if (sid != HISTINDEX_ERASED && str_matches(ix, sid, pat, plen)) ids[found++] = id;
+        }
+        return found;
+    }
+
+    // Find the matching strings once, then walk the entries newest first.
+    // Strings left unindexed by an allocation failure are compared directly.
+    histindex_catch_up(ix, SIZE_MAX);
+    unsigned char *hits = calloc(ix->nstrs / 8 + 1, 1);
+    if (!hits) return 0;
+    bool any = mark_matches(ix, pat, plen, hits);
+    if (!any && ix->indexed == ix->nstrs) {
+        free(hits);
+        return 0;
+    }
+    for (size_t id = before; id-- > 0 && found < max;) {
+        uint32_t sid = ix->entries[id];
+        if (sid == HISTINDEX_ERASED) continue;
+        bool hit = sid < ix->indexed ? hits[sid / 8] >> (sid % 8) & 1
+                                     : str_matches(ix, sid, pat, plen);
+        if (hit) ids[found++] = id;
+    }
+    free(hits);
+    return found;
+}
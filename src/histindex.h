@@ -0,0 +1,149 @@
+#ifndef HISTINDEX_H
+#define HISTINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Strings indexed per histindex_catch_up call while the shell is idle */
+#define HISTINDEX_BATCH 4096
+
+/* HISTCONTROL options */
+#define HISTCONTROL_IGNOREDUPS 0x1  // Skip a line equal to the previous entry
+#define HISTCONTROL_ERASEDUPS 0x2   // Drop earlier entries equal to a new line
+
+/* Entry id of an erased entry */
+#define HISTINDEX_ERASED UINT32_MAX
+
+/* One distinct line. Its text is at pool + off, NUL-terminated. */
+struct hist_str {
+    uint32_t off;
+    uint32_t len;
+    uint32_t hash;
+    uint32_t refs;          // Live entries using this string
+};
+
+/* String ids containing one trigram, in ascending order */
+struct posting {
+    uint32_t key;           // The three bytes, plus one so 0 marks a free slot
+    uint32_t n;
+    uint32_t cap;
+    uint32_t *ids;
+};
+
+/* The shell's history. Every distinct line is stored once in a single
+ * string pool, and an entry is just the 4-byte id of its string, so a
+ * command run thousands of times costs 4 bytes per run. Erased entries
+ * stay in place as HISTINDEX_ERASED so ids never move.
+ *
+ * For searching, each string is split into trigrams and each trigram maps
+ * to the strings containing it. Strings are only ever appended, so the
+ * lists stay sorted. A new string is indexed later, in batches, so a large
+ * history costs nothing at startup. */
+struct histindex {
+    char *pool;
+    size_t pool_len;
+    size_t pool_cap;
+    struct hist_str *strs;
+    size_t nstrs;
+    size_t strs_cap;
+    uint32_t *interned;     // Open-addressed table of string id + 1
+    size_t ninterned;
+    uint32_t *entries;      // String id of each entry, oldest first
+    size_t nentries;
+    size_t entries_cap;
+    size_t live;            // Entries not erased
+    unsigned control;       // HISTCONTROL_* bits
+    size_t indexed;         // Strings whose trigrams are in the table
+    struct posting *slots;  // Open-addressed table of posting lists
+    size_t nslots;
+    size_t used;
+};
+
+/**
+ * @brief Initialize an empty history.
+ *
+ * @param ix The history
+ * @param control HISTCONTROL_* bits
+ */
+void histindex_init(struct histindex *ix, unsigned control);
+
+/**
+ * @brief Free the history and everything in it.
+ *
+ * @param ix The history
+ */
+void histindex_destroy(struct histindex *ix);
+
+/**
+ * @brief Parse a HISTCONTROL value: a colon-separated list of ignoredups,
+ * erasedups, ignorespace and ignoreboth, as in bash. Leading spaces are
+ * trimmed before lines reach the history, so ignorespace has no effect.
+ *
+ * @param s The value, or NULL
+ * @return HISTCONTROL_* bits
+ */
+unsigned histcontrol_parse(const char *s);
+
+/**
+ * @brief Append an entry, applying the HISTCONTROL options. Its id is the
+ * number of entries before it. The entry is searchable right away; its
+ * string, if new, is only indexed by the next histindex_catch_up or
+ * histindex_search.
+ *
+ * @param ix The history
+ * @param line The entry's text
+ * @param len Length of line
+ * @return 1 if the entry was added, 0 if ignoredups skipped it, -1 if
+ * memory ran out
+ */
+int histindex_add(struct histindex *ix, const char *line, size_t len);
+
+/**
+ * @brief Text of an entry.
+ *
+ * @param ix The history
+ * @param id The entry
+ * @param len Receives the length of the text, if not NULL
+ * @return The NUL-terminated text, or NULL if the entry was erased. It
+ * moves when the pool grows, so do not keep it across histindex_add.
+ */
+const char *histindex_text(const struct histindex *ix, size_t id, size_t *len);
+
+/**
+ * @brief Index up to max strings that have been added but not indexed.
+ *
+ * @param ix The history
+ * @param max Most strings to index
+ * @return Number of strings still waiting to be indexed
+ */
+size_t histindex_catch_up(struct histindex *ix, size_t max);
+
+/**
+ * @brief Find entries containing pat, newest first. Patterns of three or
+ * more bytes are answered from the trigram lists, so only strings holding
+ * every trigram of pat are compared; shorter ones fall back to a scan.
+ * Any strings not yet indexed are indexed first.
+ *
+ * @param ix The history
+ * @param pat The substring to look for
+ * @param plen Length of pat
+ * @param before Only entries with smaller ids are considered; pass
+ * ix->nentries to search everything, or the previous match to continue
+ * @param ids Receives the ids of the matches
+ * @param max Room in ids
+ * @return Number of ids stored
+ */
+size_t histindex_search(struct histindex *ix, const char *pat, size_t plen,
+                        size_t before, size_t *ids, size_t max);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
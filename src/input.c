@@ -0,0 +1,191 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <readline/readline.h>
+#include "input.h"
+
+static void input_reset(struct input *in, enum input_kind kind, int fd) {
+    memset(in, 0, sizeof(*in));
+    in->kind = kind;
+    in->fd = fd;
+}
+
+void input_init_readline(struct input *in) {
+    input_reset(in, INPUT_READLINE, -1);
+}
+
+void input_init_fd(struct input *in, int fd, bool shared) {
+    input_reset(in, INPUT_FD, fd);
+    in->shared = shared;
+    in->seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+}
+
+int input_init_file(struct input *in, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        input_init_fd(in, fd, false);
+        return 0;
+    }
+
+    input_reset(in, INPUT_MMAP, -1);
+    in->eof = true;
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        input_init_fd(in, fd, false);
+        return 0;
+    }
+    // The mapping keeps the file alive; the descriptor is no longer needed
+    close(fd);
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    in->buf = map;
+    in->end = (size_t)st.st_size;
+    return 0;
+}
+
+int input_init_string(struct input *in, const char *s) {
+    input_reset(in, INPUT_STRING, -1);
+    size_t n = strlen(s);
+    in->buf = malloc(n + 1);
+    if (!in->buf) return -1;
+    memcpy(in->buf, s, n + 1);
+    in->cap = n + 1;
+    in->end = n;
+    in->eof = true;
+    return 0;
+}
+
+// Reads another block, compacting or growing the buffer to make room
+static void fill(struct input *in) {
+    if (in->start > 0) {
+        memmove(in->buf, in->buf + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+    }
+
+    // Always keep one spare byte to terminate a final unterminated line
+    if (in->cap - in->end < INPUT_BUFSIZE / 2) {
+        size_t cap = in->cap ? in->cap * 2 : INPUT_BUFSIZE;
+        char *buf = realloc(in->buf, cap);
+        if (!buf) {
+            perror("input");
+            in->eof = true;
+            return;
+        }
+        in->buf = buf;
+        in->cap = cap;
+    }
+
+    // Whatever is read from a shared pipe is lost to the commands
+    size_t want = in->shared && !in->seekable ? 1 : in->cap - in->end - 1;
+    for (;;) {
+        ssize_t n = read(in->fd, in->buf + in->end, want);
+        if (n > 0) {
+            in->end += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (n < 0) perror("read");
+            in->eof = true;
+        }
+        return;
+    }
+}
+
+static char *next_buffered(struct input *in, size_t *len) {
+    // Bytes after start already searched, so byte-sized reads stay linear
+    size_t seen = 0;
+    for (;;) {
+        char *start = in->buf + in->start;
+        size_t avail = in->end - in->start;
+        char *nl = avail > seen ? memchr(start + seen, '\n', avail - seen) : NULL;
+        seen = avail;
+        if (nl) {
+            *nl = '\0';
+            *len = (size_t)(nl - start);
+            in->start += *len + 1;
+            return start;
+        }
+
+        if (in->eof) {
+            if (in->start >= in->end) return NULL;
+            in->buf[in->end] = '\0';
+            *len = in->end - in->start;
+            in->start = in->end;
+            return start;
+        }
+        fill(in);
+    }
+}
+
+// Returns the next line of a mapping without touching the pages, which are
+// read-only. Pages already consumed are dropped every INPUT_DROP_BYTES so a
+// huge script does not stay resident; the kernel re-reads them if needed.
+static char *next_mapped(struct input *in, size_t *len) {
+    if (in->start >= in->end) return NULL;
+
+    char *start = in->buf + in->start;
+    size_t left = in->end - in->start;
+    char *nl = memchr(start, '\n', left);
+    *len = nl ? (size_t)(nl - start) : left;
+    in->start += nl ? *len + 1 : *len;
+
+    // Keep the current line's pages; everything before them can go
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t keep = (size_t)(start - in->buf) & ~(page - 1);
+    if (keep - in->dropped >= INPUT_DROP_BYTES) {
+        madvise(in->buf + in->dropped, keep - in->dropped, MADV_DONTNEED);
+        in->dropped = keep;
+    }
+    return start;
+}
+
+char *input_next(struct input *in, const char *prompt, size_t *len) {
+    char *line;
+    if (in->kind == INPUT_READLINE) {
+        free(in->rl_line);
+        in->rl_line = line = readline(prompt);
+        if (line) *len = strlen(line);
+    } else if (in->kind == INPUT_MMAP) {
+        line = next_mapped(in, len);
+    } else {
+        line = next_buffered(in, len);
+    }
+    if (line) in->lineno++;
+    return line;
+}
+
+void input_sync(struct input *in) {
+    if (in->kind != INPUT_FD || !in->shared || !in->seekable) return;
+    size_t ahead = in->end - in->start;
+    if (ahead == 0) return;
+    // The bytes stay in the buffer, since the last line still points there,
+    // but they are dropped and read again later
+    if (lseek(in->fd, -(off_t)ahead, SEEK_CUR) >= 0) {
+        in->end = in->start;
+        in->eof = false;
+    }
+}
+
+void input_destroy(struct input *in) {
+    free(in->rl_line);
+    if (in->kind == INPUT_MMAP) {
+        if (in->buf) munmap(in->buf, in->end);
+    } else {
+        free(in->buf);
+    }
+    if (in->kind == INPUT_FD && in->fd > STDIN_FILENO) close(in->fd);
+    input_reset(in, in->kind, -1);
+}
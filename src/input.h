@@ -0,0 +1,118 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Bytes read from a script or pipe per read() call, except from a shared
+ * unseekable descriptor, which is read a byte at a time */
+#define INPUT_BUFSIZE (128 * 1024)
+
+/* Consumed pages of a mapped script are dropped in steps of this size */
+#define INPUT_DROP_BYTES (16 * 1024 * 1024)
+
+enum input_kind {
+    INPUT_READLINE,  // Interactive: readline with prompt and editing
+    INPUT_FD,        // Standard input, or a script that cannot be mapped
+    INPUT_MMAP,      // A regular script file, mapped read-only
+    INPUT_STRING,    // The argument of -c
+};
+
+/* Where the shell's command lines come from */
+struct input {
+    enum input_kind kind;
+    int fd;
+    char *buf;          // Buffered input or the mapping; lines live in here
+    size_t cap;         // Allocated size of buf, 0 when it is a mapping
+    size_t start;       // First byte not yet returned
+    size_t end;         // One past the last byte read
+    bool eof;
+    bool shared;        // fd is the shell's stdin, which commands inherit
+    bool seekable;      // and read-ahead can be given back with lseek
+    size_t dropped;     // Bytes of the mapping already released with madvise
+    char *rl_line;      // Last line from readline, freed on the next call
+    unsigned long lineno;
+};
+
+/**
+ * @brief Read lines interactively with readline.
+ *
+ * @param in The input
+ */
+void input_init_readline(struct input *in);
+
+/**
+ * @brief Read lines from a descriptor in INPUT_BUFSIZE blocks. The input
+ * takes ownership of fd and closes it in input_destroy unless it is stdin.
+ *
+ * A shared descriptor is also read by the commands the shell runs, such as
+ * `head -1` in a script piped to the shell, so they must find the lines
+ * after their own. Like bash, the shell then reads a pipe one byte at a
+ * time so it never reads past a newline, and a seekable file in blocks that
+ * input_sync gives back before each command starts.
+ *
+ * @param in The input
+ * @param fd The descriptor
+ * @param shared True if commands inherit fd, as they do the shell's stdin
+ */
+void input_init_fd(struct input *in, int fd, bool shared);
+
+/**
+ * @brief Read lines from the file at path. Regular files are mapped with
+ * mmap so lines are handed out straight from the page cache and never
+ * copied; anything else (a FIFO, a device) falls back to input_init_fd.
+ *
+ * @param in The input
+ * @param path The script to run
+ * @return 0 on success, -1 with errno set if the file could not be opened
+ */
+int input_init_file(struct input *in, const char *path);
+
+/**
+ * @brief Read lines from a string, e.g. the argument of -c.
+ *
+ * @param in The input
+ * @param s The commands
+ * @return 0 on success, -1 if the copy could not be allocated
+ */
+int input_init_string(struct input *in, const char *s);
+
+/**
+ * @brief Return the next line without its newline. For buffered and mapped
+ * input the line points into the input's own memory, so nothing is copied.
+ * Lines from a mapped file are read-only and not NUL-terminated; callers
+ * must go by len and must not write through the pointer.
+ *
+ * @param in The input
+ * @param prompt Prompt for readline; ignored by the other kinds
+ * @param len Receives the length of the line
+ * @return The line, valid until the next call, or NULL at end of input
+ */
+char *input_next(struct input *in, const char *prompt, size_t *len);
+
+/**
+ * @brief Move a shared seekable descriptor back to the first byte that has
+ * not been returned as a line, so a command started next reads from there.
+ * Does nothing for any other input.
+ *
+ * @param in The input
+ */
+void input_sync(struct input *in);
+
+/**
+ * @brief Release the buffer and close the descriptor, if the input owns one.
+ *
+ * @param in The input
+ */
+void input_destroy(struct input *in);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
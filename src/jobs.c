@@ -0,0 +1,224 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "sink.h"
+#include "timing.h"
+
+static const char *const state_names[] = {
+    [JOB_RUNNING] = "Running",
+    [JOB_STOPPED] = "Stopped",
+    [JOB_DONE] = "Done",
+};
+
+void jobs_init(struct job_table *jt) {
+    jt->slots = NULL;
+    jt->nslots = 0;
+    jt->current = 0;
+    jt->previous = 0;
+}
+
+static void job_free(struct job *j) {
+    free(j->procs);
+    free(j->cmd);
+    free(j);
+}
+
+void jobs_destroy(struct job_table *jt) {
+    for (size_t i = 0; i < jt->nslots; i++) {
+        struct job *j = jt->slots[i];
+        if (!j) continue;
+        if (j->state == JOB_STOPPED) {
+            kill(-j->pgid, SIGHUP);
+            kill(-j->pgid, SIGCONT);
+        }
+        job_free(j);
+    }
+    free(jt->slots);
+    jobs_init(jt);
+}
+
+// Makes id the '+' job and demotes the old one to '-'
+static void make_current(struct job_table *jt, int id) {
+    if (jt->current != id) {
+        jt->previous = jt->current;
+        jt->current = id;
+    }
+}
+
+struct job *jobs_add(struct job_table *jt, const struct job *j) {
+    // Like bash, the new job gets one more than the highest number in use
+    size_t id = jt->nslots;
+    while (id > 0 && !jt->slots[id - 1]) id--;
+    id++;
+
+    if (id > jt->nslots) {
+        size_t n = jt->nslots ? jt->nslots * 2 : 8;
+        struct job **slots = realloc(jt->slots, n * sizeof(*slots));
+        if (!slots) return NULL;
+        memset(slots + jt->nslots, 0, (n - jt->nslots) * sizeof(*slots));
+        jt->slots = slots;
+        jt->nslots = n;
+    }
+
+    struct job *copy = malloc(sizeof(*copy));
+    struct job_proc *procs = malloc(j->nprocs * sizeof(*procs));
+    char *cmd = strdup(j->cmd ? j->cmd : "");
+    if (!copy || !procs || !cmd) {
+        free(copy);
+        free(procs);
+        free(cmd);
+        return NULL;
+    }
+
+    *copy = *j;
+    memcpy(procs, j->procs, j->nprocs * sizeof(*procs));
+    copy->procs = procs;
+    copy->cmd = cmd;
+    copy->id = (int)id;
+    jt->slots[id - 1] = copy;
+    make_current(jt, copy->id);
+    return copy;
+}
+
+// Highest job number in use other than skip, or 0
+static int highest_job(const struct job_table *jt, int skip) {
+    for (size_t i = jt->nslots; i > 0; i--) {
+        if (jt->slots[i - 1] && (int)i != skip) return (int)i;
+    }
+    return 0;
+}
+
+void jobs_remove(struct job_table *jt, struct job *j) {
+    int id = j->id;
+    jt->slots[id - 1] = NULL;
+    job_free(j);
+
+    if (jt->previous == id) jt->previous = 0;
+    if (jt->current == id) {
+        jt->current = jt->previous;
+        jt->previous = 0;
+    }
+    if (!jt->current) jt->current = highest_job(jt, 0);
+    if (!jt->previous) jt->previous = highest_job(jt, jt->current);
+}
+
+struct job *jobs_find(struct job_table *jt, const char *spec) {
+    int id;
+    if (!spec || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        id = jt->current;
+    } else if (strcmp(spec, "%-") == 0) {
+        id = jt->previous;
+    } else {
+        if (*spec == '%') spec++;
+        char *end;
+        long n = strtol(spec, &end, 10);
+        if (*spec == '\0' || *end != '\0' || n <= 0) return NULL;
+        id = n > (long)jt->nslots ? 0 : (int)n;
+    }
+    return id > 0 ? jt->slots[id - 1] : NULL;
+}
+
+size_t jobs_count(const struct job_table *jt) {
+    size_t n = 0;
+    for (size_t i = 0; i < jt->nslots; i++) {
+        if (jt->slots[i]) n++;
+    }
+    return n;
+}
+
+bool job_update(struct job *j, pid_t pid, int status) {
+    struct job_proc *p = NULL;
+    for (size_t i = 0; i < j->nprocs; i++) {
+        if (j->procs[i].pid == pid) {
+            p = &j->procs[i];
+            break;
+        }
+    }
+    if (!p) return false;
+
+    p->status = status;
+    if (WIFSTOPPED(status)) {
+        p->stopped = true;
+    } else if (WIFCONTINUED(status)) {
+        p->stopped = false;
+    } else {
+        p->done = true;
+        p->stopped = false;
+    }
+
+    // Done once every process is, stopped once any live one is
+    enum job_state state = JOB_DONE;
+    for (size_t i = 0; i < j->nprocs; i++) {
+        if (j->procs[i].stopped) {
+            state = JOB_STOPPED;
+            break;
+        }
+        if (!j->procs[i].done) state = JOB_RUNNING;
+    }
+    if (state != j->state) {
+        j->state = state;
+        j->notify = true;
+    }
+    return true;
+}
+
+void job_continue(struct job *j) {
+    for (size_t i = 0; i < j->nprocs; i++) j->procs[i].stopped = false;
+    if (j->state == JOB_STOPPED) j->state = JOB_RUNNING;
+    kill(-j->pgid, SIGCONT);
+}
+
+int job_status(const struct job *j) {
+    if (j->nprocs == 0) return 127;
+    int st = j->procs[j->nprocs - 1].status;
+    if (WIFEXITED(st)) return WEXITSTATUS(st);
+    if (WIFSIGNALED(st)) return 128 + WTERMSIG(st);
+    if (WIFSTOPPED(st)) return 128 + WSTOPSIG(st);
+    return 0;
+}
+
+void job_reap(struct job *j) {
+    for (size_t k = 0; k < j->nprocs; k++) {
+        int st;
+        struct rusage ru;
+        pid_t pid = j->procs[k].pid;
+        while (!j->procs[k].done
+               && wait4(pid, &st, WNOHANG | WUNTRACED | WCONTINUED, &ru) == pid) {
+            job_update(j, pid, st);
+            rusage_add(&j->usage, &ru);
+        }
+    }
+}
+
+void jobs_reap(struct job_table *jt) {
+    // Only the table's own processes are waited for: a builtin running as a
+    // pipeline stage reaps too, and must leave its pipeline's children to
+    // the wait in progress
+    for (size_t i = 0; i < jt->nslots; i++) {
+        struct job *j = jt->slots[i];
+        if (!j) continue;
+        enum job_state before = j->state;
+        job_reap(j);
+        if (j->state == JOB_STOPPED && before != JOB_STOPPED) make_current(jt, (int)i + 1);
+    }
+}
+
+void jobs_print(const struct job_table *jt, const struct job *j, struct sink *out) {
+    char mark = j->id == jt->current ? '+' : j->id == jt->previous ? '-' : ' ';
+    sink_printf(out, "[%d]%c  %-24s%s%s\n", j->id, mark, state_names[j->state],
+                j->cmd, j->state == JOB_RUNNING ? " &" : "");
+}
+
+void jobs_notify(struct job_table *jt, struct sink *out) {
+    for (size_t i = 0; i < jt->nslots; i++) {
+        struct job *j = jt->slots[i];
+        if (!j || !j->notify) continue;
+
+        j->notify = false;
+        if (j->state != JOB_RUNNING) jobs_print(jt, j, out);
+        if (j->state == JOB_DONE) jobs_remove(jt, j);
+    }
+}
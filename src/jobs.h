@@ -0,0 +1,166 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct sink;
+
+enum job_state {
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE,
+};
+
+/* One process of a job */
+struct job_proc {
+    pid_t pid;
+    int status;     // Raw wait status from the last state change
+    bool done;
+    bool stopped;
+};
+
+struct job {
+    int id;                 // Job number, 0 until the job is in the table
+    pid_t pgid;
+    enum job_state state;
+    bool notify;            // State changed and has not been reported yet
+    size_t nprocs;
+    struct job_proc *procs;
+    char *cmd;              // Command text shown by 'jobs'
+    struct rusage usage;    // Summed usage of the processes reaped so far
+};
+
+struct job_table {
+    struct job **slots;     // slots[id - 1], NULL when the id is free
+    size_t nslots;
+    int current;            // Id of the '+' job, 0 if there is none
+    int previous;           // Id of the '-' job, 0 if there is none
+};
+
+/**
+ * @brief Initialize an empty job table.
+ *
+ * @param jt The table
+ */
+void jobs_init(struct job_table *jt);
+
+/**
+ * @brief Free every job. Stopped jobs are sent SIGHUP and SIGCONT so they
+ * do not linger after the shell exits.
+ *
+ * @param jt The table
+ */
+void jobs_destroy(struct job_table *jt);
+
+/**
+ * @brief Copy a job into the table, giving it the next free job number and
+ * making it the current job. The procs array and command text are copied,
+ * so j may point at short-lived (e.g. arena) memory.
+ *
+ * @param jt The table
+ * @param j The job to copy
+ * @return The job in the table, or NULL on allocation failure
+ */
+struct job *jobs_add(struct job_table *jt, const struct job *j);
+
+/**
+ * @brief Remove a job from the table and free it.
+ *
+ * @param jt The table
+ * @param j A job returned by jobs_add or jobs_find
+ */
+void jobs_remove(struct job_table *jt, struct job *j);
+
+/**
+ * @brief Look up a job by spec: "%n" or "n" for job n, "%%" or "%+" (or
+ * NULL) for the current job, "%-" for the one before it.
+ *
+ * @param jt The table
+ * @param spec The job spec
+ * @return The job, or NULL if there is no such job
+ */
+struct job *jobs_find(struct job_table *jt, const char *spec);
+
+/**
+ * @brief Number of jobs in the table.
+ *
+ * @param jt The table
+ * @return The count
+ */
+size_t jobs_count(const struct job_table *jt);
+
+/**
+ * @brief Record a wait status for one of the job's processes and recompute
+ * the job's state.
+ *
+ * @param j The job
+ * @param pid The process that changed state
+ * @param status Its wait status
+ * @return True if pid belongs to the job
+ */
+bool job_update(struct job *j, pid_t pid, int status);
+
+/**
+ * @brief Send SIGCONT to the job's process group and mark it running.
+ *
+ * @param j The job
+ */
+void job_continue(struct job *j);
+
+/**
+ * @brief Exit status of a job in the shell's $? convention, taken from its
+ * last process.
+ *
+ * @param j The job
+ * @return The status
+ */
+int job_status(const struct job *j);
+
+/**
+ * @brief Collect every pending state change of the job's processes without
+ * blocking and record it, together with what they cost.
+ *
+ * @param j The job
+ */
+void job_reap(struct job *j);
+
+/**
+ * @brief Collect every pending state change of the table's processes
+ * without blocking and record it. Children that are not in the table are
+ * left alone.
+ *
+ * @param jt The table
+ */
+void jobs_reap(struct job_table *jt);
+
+/**
+ * @brief Print one line describing a job, as 'jobs' does.
+ *
+ * @param jt The table
+ * @param j The job
+ * @param out Where to write
+ */
+void jobs_print(const struct job_table *jt, const struct job *j, struct sink *out);
+
+/**
+ * @brief Report jobs whose state changed since the last call and drop the
+ * ones that have finished.
+ *
+ * @param jt The table
+ * @param out Where to write
+ */
+void jobs_notify(struct job_table *jt, struct sink *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -1,4 +1,3 @@
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,14 +5,17 @@
 #include <pwd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <signal.h>
-#include <limits.h>  // For ARG_MAX
+#include <poll.h>
+#include <sys/signalfd.h>
 #include "lab.h"
+#include "lexer.h"
+#include "scan.h"
 
-// Stores the last stopped process
-static pid_t last_stopped_pid = -1;
+#define DEFAULT_PROMPT "shell> "
 
 // Displays the prompt
 char *get_prompt(const char *env) {
@@ -25,13 +27,26 @@ char *get_prompt(const char *env) {
     }
 
     // Ensure the default prompt has a space at the end
-    char *default_prompt = "shell> ";
+    char *default_prompt = DEFAULT_PROMPT;
    // printf("[DEBUG] Using default prompt: '%s' (length: %lu)\n", default_prompt, strlen(default_prompt));
 
     return strdup(default_prompt);
 }
 
 
+// Renders the prompt, reusing the cached text when nothing it shows changed
+const char *sh_prompt(struct shell *sh) {
+    const char *tmpl = getenv("MY_PROMPT");
+    if (!tmpl || !*tmpl) tmpl = DEFAULT_PROMPT;
+
+    struct prompt_inputs in = {
+        .cwd_gen = sh->cwd_gen,
+        .status = sh->last_status,
+        .njobs = jobs_count(&sh->jobs),
+    };
+    return prompt_render(&sh->prompt, tmpl, &in);
+}
+
 // Changes directory
 int change_dir(char **dir) {
     const char *target = dir[1];
@@ -59,149 +74,595 @@ int change_dir(char **dir) {
     return 0;
 }
 
-// Parses a command string
+// Measures line for cmd_parse: the number of tokens and the bytes their
+// text needs. Returns false on a lexical error such as an open quote.
+static bool measure_tokens(char const *line, size_t len, size_t *ntok, size_t *text) {
+    struct lexer lx;
+    struct token tok;
+    *ntok = 0;
+    *text = 0;
+
+    lexer_init(&lx, line, len);
+    while (lexer_next(&lx, &tok) != TOK_EOF) {
+        if (tok.kind == TOK_ERROR) {
+            fprintf(stderr, "syntax error: %s\n", lx.error);
+            return false;
+        }
+        (*ntok)++;
+        *text += tok.len + 1;
+    }
+    return true;
+}
+
+// Lexes line again, writing each token's text into buf and pointing args at it
+static void split_tokens(char const *line, size_t len, char **args, char *buf) {
+    struct lexer lx;
+    struct token tok;
+    size_t i = 0;
+
+    lexer_init(&lx, line, len);
+    while (lexer_next(&lx, &tok) != TOK_EOF) {
+        args[i++] = buf;
+        buf += token_text(line, &tok, buf) + 1;
+    }
+    args[i] = NULL;  // NULL-terminate the array for execvp()
+}
+
+// Parses a command string. The argv array and the token text share one
+// allocation: (ntok + 1) pointers followed by the NUL-separated tokens.
+// Quotes and escapes are removed; operators come through as their text.
 char **cmd_parse(char const *line) {
     if (!line || *line == '\0') return NULL; // Ignore empty input
 
-    long arg_max = sysconf(_SC_ARG_MAX);
-    if (arg_max < 0) arg_max = _POSIX_ARG_MAX;  // Fallback
+    size_t len = strlen(line);
+    size_t ntok, text;
+    if (!measure_tokens(line, len, &ntok, &text)) return NULL;
 
-    char **args = malloc(sizeof(char *) * (arg_max + 1));
+    char **args = malloc(sizeof(char *) * (ntok + 1) + text);
     if (!args) {
         perror("malloc failed");
         return NULL;
     }
 
-    char *copy = strdup(line);
-    if (!copy) {
-        perror("strdup failed");
-        free(args);
-        return NULL;
+    split_tokens(line, len, args, (char *)(args + ntok + 1));
+    return args;
+}
+
+// Frees the argv block returned by cmd_parse (pointers and text together)
+void cmd_free(char **line) {
+    free(line);
+}
+
+// Trims out any unnecessary whitespace. The leading run is skipped with the
+// vectorized scanner; the trailing run is short and checked byte by byte.
+char *trim_white(char *line) {
+    if (!line) return NULL;
+
+    size_t len = strlen(line);
+    size_t lead = scan_space(line, len);
+    line += lead;
+    len -= lead;
+
+    while (len > 0 && scan_space(line + len - 1, 1)) line[--len] = '\0';
+
+    return line;
+}
+
+// Same as trim_white, but only narrows the span so read-only lines work
+const char *trim_white_n(const char *line, size_t *len) {
+    size_t n = *len;
+    size_t lead = scan_space(line, n);
+    line += lead;
+    n -= lead;
+
+    while (n > 0 && scan_space(line + n - 1, 1)) n--;
+
+    *len = n;
+    return line;
+}
+
+// Built-in 'exit' command
+static bool builtin_exit(struct shell *sh, char **argv, struct sink *out) {
+    UNUSED(out);
+    int status = argv[1] ? atoi(argv[1]) : sh->last_status;
+    bool interactive = sh->shell_is_interactive;
+    sh_destroy(sh);  // Clean up allocated memory
+    if (interactive) printf("Exiting shell...\n");
+    exit(status);
+}
+
+// Built-in 'cd' command
+static bool builtin_cd(struct shell *sh, char **argv, struct sink *out) {
+    UNUSED(out);
+    if (change_dir(argv) != 0) return false;
+    sh->cwd_gen++;
+    return true;
+}
+
+// Prints the entries matching pattern, oldest first, numbered like 'history'
+static bool print_history_matches(struct shell *sh, const char *pattern, struct sink *out) {
+    struct histindex *ix = &sh->histindex;
+    size_t *ids = malloc((ix->live + 1) * sizeof(*ids));
+    if (!ids) return false;
+    size_t n = histindex_search(ix, pattern, strlen(pattern), ix->nentries, ids, ix->live);
+    // Number the matches by counting live entries up to each one
+    size_t num = 0;
+    for (size_t id = 0; n > 0 && id < ix->nentries; id++) {
+        size_t len;
+        const char *text = histindex_text(ix, id, &len);
+        if (!text) continue;
+        num++;
+        if (id != ids[n - 1]) continue;
+        n--;
+        sink_printf(out, "%zu: ", num);
+        sink_write_ref(out, text, len);
+        sink_write(out, "\n", 1);
     }
+    free(ids);
+    return true;
+}
 
-    int i = 0;
-    char *token = strtok(copy, " ");
-    while (token && i < arg_max) {
-        args[i] = strdup(token);
-        if (!args[i]) {
-            perror("strdup failed");
-            for (int j = 0; j < i; j++) free(args[j]);
-            free(copy);
-            free(args);
-            return NULL;
+// Built-in 'history' command; 'history -s pattern' lists matching entries
+static bool builtin_history(struct shell *sh, char **argv, struct sink *out) {
+    if (argv[1] && strcmp(argv[1], "-s") == 0) {
+        if (!argv[2]) {
+            fprintf(stderr, "history: -s: pattern required\n");
+            return false;
         }
-        token = strtok(NULL, " ");
-        i++;
+        return print_history_matches(sh, argv[2], out);
     }
+    // The interned store holds every entry, erased ones as gaps
+    size_t num = 0;
+    for (size_t id = 0; id < sh->histindex.nentries; id++) {
+        size_t len;
+        const char *text = histindex_text(&sh->histindex, id, &len);
+        if (!text) continue;
+        sink_printf(out, "%zu: ", ++num);
+        sink_write_ref(out, text, len);
+        sink_write(out, "\n", 1);
+    }
+    return true;
+}
 
-    args[i] = NULL;  // NULL-terminate the array for execvp()
-    free(copy);
-    return args;
+// Built-in 'hash' command: show, forget (-r) or pre-load command paths
+static bool builtin_hash(struct shell *sh, char **argv, struct sink *out) {
+    if (!argv[1]) {
+        cmd_hash_print(&sh->cmd_hash, out);
+    } else if (strcmp(argv[1], "-r") == 0) {
+        cmd_hash_clear(&sh->cmd_hash);
+    } else {
+        for (int i = 1; argv[i]; i++) {
+            if (!cmd_hash_lookup(&sh->cmd_hash, argv[i])) {
+                fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            }
+        }
+    }
+    return true;
 }
 
-// Frees the memory allocated for an array of strings and the array itself
-void cmd_free(char **line) {
-    if (!line) return;
+// Built-in 'jobs' command: list background and stopped jobs
+static bool builtin_jobs(struct shell *sh, char **argv, struct sink *out) {
+    UNUSED(argv);
+    jobs_reap(&sh->jobs);
+    for (size_t i = 0; i < sh->jobs.nslots; i++) {
+        struct job *j = sh->jobs.slots[i];
+        if (!j) continue;
+        j->notify = false;
+        jobs_print(&sh->jobs, j, out);
+        if (j->state == JOB_DONE) jobs_remove(&sh->jobs, j);
+    }
+    return true;
+}
 
-    for (size_t i = 0; line[i] != NULL; i++) {
-        free(line[i]);
+// Built-in 'shstat' command: show (or with -r, reset) hot-path counters
+static bool builtin_shstat(struct shell *sh, char **argv, struct sink *out) {
+    if (argv[1] && strcmp(argv[1], "-r") == 0) {
+        shstat_reset(&sh->stats);
+        sh->arena.allocated = 0;
+    } else {
+        shstat_print(&sh->stats, sh->arena.allocated, out);
     }
-    free(line);
+    return true;
 }
 
-// Trims out any unnecessary whitespace
-char *trim_white(char *line) {
-    if (!line) return NULL;
+// Built-in 'fg' command: resumes a job in the foreground
+static bool builtin_fg(struct shell *sh, char **argv, struct sink *out) {
+    struct job *j = jobs_find(&sh->jobs, argv[1]);
+    if (!j) {
+        fprintf(stderr, "fg: %s: no such job\n", argv[1] ? argv[1] : "current");
+        return false;
+    }
+    sink_printf(out, "%s\n", j->cmd);
+    sink_flush(out);
+    job_continue(j);
+    wait_foreground(sh, j);
+    return true;
+}
 
-    while (isspace(*line)) line++;
-    char *end = line + strlen(line) - 1;
-    while (end > line && isspace(*end)) *end-- = '\0';
+// Built-in 'bg' command: resumes a stopped job in the background
+static bool builtin_bg(struct shell *sh, char **argv, struct sink *out) {
+    struct job *j = jobs_find(&sh->jobs, argv[1]);
+    if (!j) {
+        fprintf(stderr, "bg: %s: no such job\n", argv[1] ? argv[1] : "current");
+        return false;
+    }
+    job_continue(j);
+    sink_printf(out, "[%d] %s &\n", j->id, j->cmd);
+    return true;
+}
 
-    return line;
+// Every builtin. Builtins without BUILTIN_PIPELINE change shell state, so
+// inside a pipeline they get a subshell.
+enum builtin_id {
+    B_BG, B_CD, B_EXIT, B_FG, B_HASH, B_HISTORY, B_JOBS, B_SHSTAT,
+};
+
+static const struct builtin builtins[] = {
+    [B_BG] = { "bg", builtin_bg, 0 },
+    [B_CD] = { "cd", builtin_cd, 0 },
+    [B_EXIT] = { "exit", builtin_exit, 0 },
+    [B_FG] = { "fg", builtin_fg, 0 },
+    [B_HASH] = { "hash", builtin_hash, BUILTIN_PIPELINE },
+    [B_HISTORY] = { "history", builtin_history, BUILTIN_PIPELINE },
+    [B_JOBS] = { "jobs", builtin_jobs, BUILTIN_PIPELINE },
+    [B_SHSTAT] = { "shstat", builtin_shstat, BUILTIN_PIPELINE },
+};
+
+// Looks a name up with a switch on its first byte, which narrows it to one
+// candidate (two for 'h'), then a single strcmp. A new builtin needs a
+// table entry and a case here.
+const struct builtin *builtin_find(const char *name) {
+    if (!name) return NULL;
+    enum builtin_id id;
+    switch (name[0]) {
+        case 'b': id = B_BG; break;
+        case 'c': id = B_CD; break;
+        case 'e': id = B_EXIT; break;
+        case 'f': id = B_FG; break;
+        case 'h': id = name[1] == 'a' ? B_HASH : B_HISTORY; break;
+        case 'j': id = B_JOBS; break;
+        case 's': id = B_SHSTAT; break;
+        default: return NULL;
+    }
+    return strcmp(name, builtins[id].name) == 0 ? &builtins[id] : NULL;
+}
+
+// Reports whether name is a builtin without running it
+bool is_builtin(const char *name) {
+    return builtin_find(name) != NULL;
+}
+
+// Reports whether a builtin can run in-process as a pipeline stage
+bool builtin_in_pipeline(const char *name) {
+    const struct builtin *b = builtin_find(name);
+    return b && (b->flags & BUILTIN_PIPELINE);
 }
 
-// Executes built-in commands
+// Executes built-in commands, writing their output to stdout
 bool do_builtin(struct shell *sh, char **argv) {
-    if (!argv || !argv[0]) return false;
+    struct sink out;
+    fflush(stdout);
+    sink_init(&out, STDOUT_FILENO);
+    bool rval = do_builtin_sink(sh, argv, &out);
+    sink_flush(&out);
+    return rval;
+}
+
+// Dispatches a builtin, counting the time it takes under STAT_BUILTIN
+bool do_builtin_sink(struct shell *sh, char **argv, struct sink *out) {
+    const struct builtin *b = builtin_find(argv ? argv[0] : NULL);
+    if (!b) return false;  // Not a built-in command, will be exec'd instead
+    uint64_t t0 = shstat_now();
+    bool rval = b->fn(sh, argv, out);
+    shstat_add(&sh->stats, STAT_BUILTIN, t0);
+    return rval;
+}
 
-    // Built-in 'exit' command
-    if (strcmp(argv[0], "exit") == 0) {
-        sh_destroy(sh);  // Clean up allocated memory
-        printf("Exiting shell...\n");
-        exit(0);
+// readline key sequence bound to the indexed history search
+#define HISTORY_SEARCH_KEYSEQ "\\C-xr"
+
+// The shell readline hooks act on; they take no user data
+static struct shell *rl_shell;
+
+// Adds a line to the store and mirrors the outcome in readline's list,
+// which only serves the arrow keys. Returns false if HISTCONTROL dropped it.
+static bool remember(struct shell *sh, const char *line, size_t len) {
+    if (histindex_add(&sh->histindex, line, len) == 0) return false;
+    if (sh->histindex.control & HISTCONTROL_ERASEDUPS) {
+        for (int i = history_length; i-- > 0;) {
+            HIST_ENTRY *e = history_get(i + history_base);
+            if (e && strcmp(e->line, line) == 0) free_history_entry(remove_history(i));
+        }
     }
+    add_history(line);
+    return true;
+}
+
+void sh_add_history(struct shell *sh, const char *line, size_t len) {
+    if (remember(sh, line, len)) histfile_append(&sh->histfile, line, len);
+}
+
+// readline command: replace the line with the newest history entry that
+// contains it. Repeating the key steps to older matches of the same text.
+static int index_search_history(int count, int key) {
+    static char *pattern;       // What was typed before the first press
+    static size_t before;       // Id of the match shown, to continue from
+    static char *shown;         // Text of that match; the pool may move
+    UNUSED(count);
+    UNUSED(key);
 
-    // Built-in 'cd' command
-    else if (strcmp(argv[0], "cd") == 0) {
-        return change_dir(argv) == 0;
+    struct histindex *ix = &rl_shell->histindex;
+    bool again = pattern && shown && strcmp(rl_line_buffer, shown) == 0;
+    if (!again) {
+        free(pattern);
+        pattern = strdup(rl_line_buffer);
+        before = ix->nentries;
+        if (!pattern) return 1;
     }
 
-    // Built-in 'history' command
-    else if (strcmp(argv[0], "history") == 0) {
-        HIST_ENTRY **hist_list = history_list();
-        if (hist_list) {
-            for (int i = 0; hist_list[i]; i++) {
-                printf("%d: %s\n", i + history_base, hist_list[i]->line);
-            }
+    // Older runs of the line already shown are skipped
+    size_t id;
+    const char *text;
+    do {
+        if (histindex_search(ix, pattern, strlen(pattern), before, &id, 1) == 0) {
+            rl_ding();
+            return 0;
         }
-        return true;
-    }
-
-    // Built-in 'fg' command: resumes the last stopped process
-    else if (strcmp(argv[0], "fg") == 0) {
-        if (last_stopped_pid > 0) {
-            printf("Resuming process %d\n", last_stopped_pid);
-            kill(last_stopped_pid, SIGCONT);  // Resume the process
-            tcsetpgrp(STDIN_FILENO, last_stopped_pid); // Give it terminal control
-            waitpid(last_stopped_pid, NULL, WUNTRACED);  // Wait for it
-            tcsetpgrp(STDIN_FILENO, getpid());  // Restore shell control
-            last_stopped_pid = -1;  // Reset
-        } else {
-            printf("fg: No stopped jobs\n");
+        before = id;
+        text = histindex_text(ix, id, NULL);
+    } while (again && strcmp(text, shown) == 0);
+
+    char *copy = strdup(text);
+    if (!copy) return 1;
+    free(shown);
+    shown = copy;
+    rl_replace_line(shown, 0);
+    rl_point = rl_end;
+    return 0;
+}
+
+// Collects child state changes if any SIGCHLD has arrived since last time
+bool sh_reap(struct shell *sh) {
+    struct signalfd_siginfo info[16];
+    bool pending = sh->sigchld_fd < 0;
+
+    // SIGCHLDs coalesce, so draining the queue and reaping once is enough
+    while (sh->sigchld_fd >= 0 && read(sh->sigchld_fd, info, sizeof(info)) > 0) {
+        pending = true;
+    }
+    if (pending) {
+        uint64_t t0 = shstat_now();
+        jobs_reap(&sh->jobs);
+        shstat_add(&sh->stats, STAT_WAIT, t0);
+    }
+    return pending;
+}
+
+// readline input function: waits for either a key or a SIGCHLD, so children
+// are reaped the moment they exit rather than when the next prompt is drawn.
+// Idle time goes to indexing history.
+static int sh_getc(FILE *in) {
+    struct pollfd fds[2] = {
+        { .fd = fileno(in), .events = POLLIN },
+        { .fd = rl_shell->sigchld_fd, .events = POLLIN },
+    };
+
+    struct histindex *ix = &rl_shell->histindex;
+    bool indexing = true;
+    for (;;) {
+        // While history is waiting to be indexed, only peek, and index a
+        // batch whenever no key is ready
+        size_t pending = indexing ? ix->nstrs - ix->indexed : 0;
+        int ready = poll(fds, 2, pending ? 0 : -1);
+        if (ready == 0) {
+            // No progress means memory ran out; retry on the next key
+            indexing = histindex_catch_up(ix, HISTINDEX_BATCH) < pending;
+            continue;
+        }
+        if (ready < 0) {
+            if (errno != EINTR) return rl_getc(in);
+            // Let readline act on SIGWINCH and friends, as its own rl_getc does
+            if (rl_pending_signal()) rl_check_signals();
+            continue;
         }
-        return true;
+        if (fds[1].revents & POLLIN) sh_reap(rl_shell);
+        if (fds[0].revents) return rl_getc(in);
+    }
+}
+
+// Reads a numeric variable like HISTSIZE: def when unset, -1 (no limit)
+// when negative or not a number
+static long env_limit(const char *name, long def) {
+    const char *s = getenv(name);
+    if (!s || !*s) return def;
+    char *end;
+    long n = strtol(s, &end, 10);
+    return *end || n < 0 ? -1 : n;
+}
+
+static void add_history_line(void *ctx, const char *line) {
+    remember(ctx, line, strlen(line));
+}
+
+// Moves one of the shell's own descriptors to REDIR_FD_MIN or above, out of
+// reach of the redirections a lone builtin or { } group applies in place
+static int fd_move_high(int fd) {
+    if (fd < 0 || fd >= REDIR_FD_MIN) return fd;
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+    if (high < 0) return fd;
+    close(fd);
+    return high;
+}
+
+// Opens HISTFILE and loads its last HISTSIZE lines into readline. As in
+// bash, an unset HISTFILE means the default file and an empty one means
+// history is not saved.
+static void history_init(struct shell *sh) {
+    if (!sh->shell_is_interactive) {
+        histfile_open(&sh->histfile, NULL);
+        return;
     }
 
-    return false; // Not a built-in command, will be handled by execvp()
+    const char *path = getenv("HISTFILE");
+    char *def = NULL;
+    const char *home = getenv("HOME");
+    if (!path && home) {
+        size_t n = strlen(home) + sizeof(HISTFILE_DEFAULT_NAME) + 1;
+        def = malloc(n);
+        if (def) snprintf(def, n, "%s/%s", home, HISTFILE_DEFAULT_NAME);
+        path = def;
+    }
+
+    if (histfile_open(&sh->histfile, path) != 0) perror(path);
+    sh->histfile.fd = fd_move_high(sh->histfile.fd);
+    // The store keeps the full history; readline's copy, which only backs
+    // the arrow keys, is held to HISTSIZE
+    long size = env_limit("HISTSIZE", HISTFILE_DEFAULT_SIZE);
+    if (size >= 0) stifle_history((int)size);
+    histfile_load(&sh->histfile, size < 0 ? SIZE_MAX : (size_t)size,
+                  add_history_line, sh);
+    // Only once the file has been read, so the two never overlap
+    histfile_trim_background(&sh->histfile,
+                             env_limit("HISTFILESIZE", HISTFILE_DEFAULT_SIZE));
+    free(def);
 }
 
 // Initializes the shell and ignores certain signals
 void sh_init(struct shell *sh) {
-    sh->prompt = get_prompt("MY_PROMPT");
+    prompt_init(&sh->prompt);
+    sh->last_status = 0;
+    sh->cwd_gen = 0;
+    arena_init(&sh->arena, 0);
+    cmd_hash_init(&sh->cmd_hash);
+    ast_cache_init(&sh->ast_cache);
     sh->shell_terminal = STDIN_FILENO;
     sh->shell_pgid = getpid();
+    jobs_init(&sh->jobs);
+    sh->time_threshold_ms = time_threshold_ms();
+    shstat_reset(&sh->stats);
+    histindex_init(&sh->histindex, histcontrol_parse(getenv("HISTCONTROL")));
+
+    // Scripts, -c and piped input run without job control or readline
+    sh->shell_is_interactive = !sh->script && !sh->command
+        && isatty(sh->shell_terminal);
 
-    // Put the shell in its own process group
-    setpgid(sh->shell_pgid, sh->shell_pgid);
-    tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
+    if (sh->shell_is_interactive) {
+        // Wait until we are in the foreground before taking the terminal
+        while (tcgetpgrp(sh->shell_terminal) != (sh->shell_pgid = getpgrp()))
+            kill(-sh->shell_pgid, SIGTTIN);
 
-    // Ignore signals in the parent shell
-    signal(SIGINT, SIG_IGN);   // Ignore Ctrl+C
-    signal(SIGQUIT, SIG_IGN);  // Ignore Ctrl+\
-    signal(SIGTSTP, SIG_IGN);  // Ignore Ctrl+Z
-    signal(SIGTTIN, SIG_IGN);
-    signal(SIGTTOU, SIG_IGN);
+        // Put the shell in its own process group
+        sh->shell_pgid = getpid();
+        setpgid(sh->shell_pgid, sh->shell_pgid);
+        tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
+        tcgetattr(sh->shell_terminal, &sh->shell_tmodes);
+
+        // Ignore signals in the parent shell
+        signal(SIGINT, SIG_IGN);   // Ignore Ctrl+C
+        signal(SIGQUIT, SIG_IGN);  // Ignore Ctrl+Backslash
+        signal(SIGTSTP, SIG_IGN);  // Ignore Ctrl+Z
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+        input_init_readline(&sh->input);
+    } else if (sh->command) {
+        if (input_init_string(&sh->input, sh->command) != 0) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+    } else if (sh->script) {
+        // Regular files are mapped, so even huge scripts are never copied
+        if (input_init_file(&sh->input, sh->script) != 0) {
+            perror(sh->script);
+            exit(127);
+        }
+    } else {
+        input_init_fd(&sh->input, STDIN_FILENO, true);
+    }
+    signal(SIGPIPE, SIG_IGN);  // In-process builtins see EPIPE instead
+
+    // Take SIGCHLD through a signalfd so readline can wait on it alongside
+    // the terminal. Children get an empty signal mask when they start.
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    sh->sigchld_fd = fd_move_high(signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC));
+    if (sh->shell_is_interactive) {
+        rl_shell = sh;
+        if (sh->sigchld_fd >= 0) rl_getc_function = sh_getc;
+
+        // Indexed substring search; inputrc can bind it to other keys, such
+        // as "\C-r": index-search-history
+        rl_add_defun("index-search-history", index_search_history, -1);
+        rl_bind_keyseq(HISTORY_SEARCH_KEYSEQ, index_search_history);
+    }
+
+    // Last, so the SIGCHLD of a background trim is caught by the signalfd
+    history_init(sh);
+}
+
+// Writes the counters as JSON to the file named by MY_SHSTAT, if set
+static void shstat_dump(struct shell *sh) {
+    const char *path = getenv(SHSTAT_ENV);
+    if (!path || !*path) return;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    struct sink out;
+    sink_init(&out, fd);
+    shstat_json(&sh->stats, sh->arena.allocated, &out);
+    sink_flush(&out);
+    close(fd);
 }
 
 // Destroys the shell and frees allocated memory
 void sh_destroy(struct shell *sh) {
-    if (sh->prompt) {
-        free(sh->prompt);
-        sh->prompt = NULL;
+    // A forked pipeline stage running 'exit' must not clobber the dump
+    if (getpid() == sh->shell_pgid) shstat_dump(sh);
+    prompt_destroy(&sh->prompt);
+    arena_destroy(&sh->arena);
+    cmd_hash_destroy(&sh->cmd_hash);
+    ast_cache_destroy(&sh->ast_cache);
+    jobs_destroy(&sh->jobs);
+    input_destroy(&sh->input);
+    histfile_close(&sh->histfile);
+    histindex_destroy(&sh->histindex);
+    if (sh->sigchld_fd >= 0) {
+        close(sh->sigchld_fd);
+        sh->sigchld_fd = -1;
+        rl_getc_function = rl_getc;
     }
 }
 
+// Reports jobs that finished or stopped since the last prompt
+void sh_report_jobs(struct shell *sh) {
+    struct sink err;
+    sh_reap(sh);
+    sink_init(&err, STDERR_FILENO);
+    jobs_notify(&sh->jobs, &err);
+    sink_flush(&err);
+}
+
 // Parses command line arguments from user input
-void parse_args(int argc, char **argv) {
+void parse_args(struct shell *sh, int argc, char **argv) {
     int c;
-    while ((c = getopt(argc, argv, "v:")) != -1) {
+    sh->script = NULL;
+    sh->command = NULL;
+    // '+' stops at the first operand so a script's own options are left alone
+    while ((c = getopt(argc, argv, "+vc:")) != -1) {
         switch (c) {
             case 'v':
-                printf("Shell Version: %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
+                printf("Shell version: %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
                 exit(0);
+            case 'c':
+                sh->command = optarg;
+                break;
             default:
-                fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-v] [-c command | file]\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
+    if (!sh->command && optind < argc) sh->script = argv[optind];
 }
@@ -6,6 +6,18 @@
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
+#include "arena.h"
+#include "astcache.h"
+#include "cmdhash.h"
+#include "exec.h"
+#include "histfile.h"
+#include "histindex.h"
+#include "input.h"
+#include "jobs.h"
+#include "shstat.h"
+#include "sink.h"
+#include "timing.h"
+#include "prompt.h"
 
 #define VERSION_MAJOR 1
 #define VERSION_MINOR 0
@@ -21,8 +33,22 @@ struct shell {
     pid_t shell_pgid;
     struct termios shell_tmodes;
     int shell_terminal;
-    char *prompt;
-    pid_t last_stopped_pid; // Added to track last stopped process
+    struct prompt prompt;   // Cached rendering of MY_PROMPT
+    int last_status;        // Exit status of the last command ($?)
+    unsigned long cwd_gen;  // Bumped by every successful cd
+    struct arena arena;     // Per-command scratch memory, reset every loop
+    struct cmd_hash cmd_hash; // Command name -> resolved path cache
+    struct ast_cache ast_cache; // Command line -> parsed tree
+    struct job_table jobs;  // Background and stopped jobs
+    struct rusage fg_usage; // What waited-for foreground processes cost
+    int sigchld_fd;         // signalfd for SIGCHLD, -1 if unavailable
+    const char *script;     // Script file given on the command line, or NULL
+    const char *command;    // Argument of -c, or NULL
+    struct input input;     // Where command lines are read from
+    long time_threshold_ms; // Report commands slower than this, -1 for never
+    struct shstat stats;    // Hot-path counters shown by 'shstat'
+    struct histfile histfile; // Where interactive history is saved
+    struct histindex histindex; // Trigram index for history searches
 };
 
 /**
@@ -36,6 +62,16 @@ struct shell {
  */
 char *get_prompt(const char *env);
 
+/**
+ * @brief Render the prompt for the next command from MY_PROMPT (or the
+ * default prompt), expanding escapes such as \w and \?. The result is
+ * cached and only rebuilt when MY_PROMPT or a value it shows has changed.
+ *
+ * @param sh The shell instance
+ * @return The prompt, valid until the next call
+ */
+const char *sh_prompt(struct shell *sh);
+
 /**
  * Changes the current working directory of the shell. Uses the Linux system
  * call chdir. With no arguments, the user’s home directory is used.
@@ -48,8 +84,11 @@ int change_dir(char **dir);
 
 /**
  * @brief Convert a line read from the user into a format that will work with
- * execvp. We limit the number of arguments to ARG_MAX loaded from sysconf.
- * This function allocates memory that must be reclaimed with the cmd_free function.
+ * execvp. Words are split on blanks with shell quoting and escapes honoured;
+ * operators such as "|" appear as their own arguments. The argument array is
+ * sized to the actual number of tokens and the token text lives in the same
+ * allocation, so each command costs a single malloc. This memory must be
+ * reclaimed with the cmd_free function.
  *
  * @param line The line to process
  * @return The parsed command in a format suitable for exec
@@ -73,6 +112,54 @@ void cmd_free(char ** line);
  */
 char *trim_white(char *line);
 
+/**
+ * @brief Like trim_white, but for a line of known length that may not be
+ * NUL-terminated or writable, such as a line of a mapped script. Nothing
+ * is modified; the trimmed span is returned instead.
+ *
+ * @param line The line to trim
+ * @param len In: the length of line. Out: the length of the trimmed span
+ * @return Start of the trimmed span inside line
+ */
+const char *trim_white_n(const char *line, size_t *len);
+
+/* Builtin may run inside the shell as a pipeline stage: it only writes
+ * output. Builtins without it change shell state and get a subshell there. */
+#define BUILTIN_PIPELINE 0x1
+
+/* A built-in command */
+struct builtin {
+    const char *name;
+    bool (*fn)(struct shell *sh, char **argv, struct sink *out);
+    unsigned flags;     // BUILTIN_* bits
+};
+
+/**
+ * @brief Find the descriptor of a builtin in constant time, whatever the
+ * number of builtins.
+ *
+ * @param name The command name
+ * @return The builtin, or NULL if name is not one
+ */
+const struct builtin *builtin_find(const char *name);
+
+/**
+ * @brief Reports whether a command name is handled by do_builtin.
+ *
+ * @param name The command name
+ * @return True if name is a built-in command
+ */
+bool is_builtin(const char *name);
+
+/**
+ * @brief Reports whether a builtin only writes output and can therefore run
+ * inside the shell when it is a stage of a pipeline.
+ *
+ * @param name The command name
+ * @return True if the builtin may run in-process in a pipeline
+ */
+bool builtin_in_pipeline(const char *name);
+
 /**
  * @brief Checks if the first argument is a built-in command like exit, cd, or jobs.
  * If the command is built-in, it will be executed inside the shell.
@@ -83,6 +170,17 @@ char *trim_white(char *line);
  */
 bool do_builtin(struct shell *sh, char **argv);
 
+/**
+ * @brief Same as do_builtin, but the builtin's output goes to out instead of
+ * stdout. The caller flushes the sink.
+ *
+ * @param sh The shell instance
+ * @param argv The command to check
+ * @param out Where the builtin writes its output
+ * @return True if the command was a built-in command
+ */
+bool do_builtin_sink(struct shell *sh, char **argv, struct sink *out);
+
 /**
  * @brief Initializes the shell for use. Allocates necessary data structures,
  * grabs control of the terminal, and puts the shell in its own process group.
@@ -100,17 +198,44 @@ void sh_init(struct shell *sh);
 void sh_destroy(struct shell *sh);
 
 /**
- * @brief Parse command line args from the user when the shell was launched
+ * @brief Parse command line args from the user when the shell was launched.
+ * Accepts -v (print the version and exit), -c command, and an optional
+ * script file. Either of the last two makes the shell non-interactive.
+ * Call this before sh_init.
  *
+ * @param sh The shell instance
  * @param argc Number of args
  * @param argv The argument array
  */
-void parse_args(int argc, char **argv);
+void parse_args(struct shell *sh, int argc, char **argv);
+
+/**
+ * @brief Reaps children if a SIGCHLD has been delivered since the last call
+ * (always, if the signalfd could not be created). Called from readline's
+ * input loop so background jobs never sit as zombies while the user types.
+ *
+ * @param sh The shell instance
+ * @return True if children were reaped
+ */
+bool sh_reap(struct shell *sh);
 
 /**
- * @brief Resumes the last stopped process using the 'fg' command.
+ * @brief Records a command line in the history: readline's list, the
+ * search index and, if one is open, the history file.
+ *
+ * @param sh The shell instance
+ * @param line The command line, NUL-terminated
+ * @param len Length of line
+ */
+void sh_add_history(struct shell *sh, const char *line, size_t len);
+
+/**
+ * @brief Collects finished and stopped background jobs and reports them on
+ * stderr, the way a shell does just before printing a prompt.
+ *
+ * @param sh The shell instance
  */
-void resume_last_stopped();
+void sh_report_jobs(struct shell *sh);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,207 @@
+#include <string.h>
+#include "lexer.h"
+#include "scan.h"
+
+// Characters that end an unquoted word
+static int is_meta(char c) {
+    switch (c) {
+    case ' ': case '\t': case '\n':
+    case '|': case '&': case ';': case '<': case '>': case '(': case ')':
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void lexer_init(struct lexer *lx, const char *src, size_t len) {
+    lx->src = src;
+    lx->len = len;
+    lx->pos = 0;
+    lx->error = NULL;
+}
+
+// Lexes the operator starting at p, returning its length
+static size_t lex_operator(const char *s, size_t n, size_t p, enum tok_kind *kind) {
+    char next = p + 1 < n ? s[p + 1] : '\0';
+    switch (s[p]) {
+    case '\n': *kind = TOK_NEWLINE; return 1;
+    case '|':
+        if (next == '|') { *kind = TOK_OR_IF; return 2; }
+        *kind = TOK_PIPE;
+        return 1;
+    case '&':
+        if (next == '&') { *kind = TOK_AND_IF; return 2; }
+        *kind = TOK_AMP;
+        return 1;
+    case ';':  *kind = TOK_SEMI;    return 1;
+    case '(':  *kind = TOK_LPAREN;  return 1;
+    case ')':  *kind = TOK_RPAREN;  return 1;
+    case '<':
+        if (next == '&') { *kind = TOK_LESSAND; return 2; }
+        if (next == '<') {
+            char third = p + 2 < n ? s[p + 2] : '\0';
+            if (third == '<') { *kind = TOK_TLESS; return 3; }
+            if (third == '-') { *kind = TOK_DLESSDASH; return 3; }
+            *kind = TOK_DLESS;
+            return 2;
+        }
+        *kind = TOK_LESS;
+        return 1;
+    case '>':
+        if (next == '>') { *kind = TOK_DGREAT; return 2; }
+        if (next == '&') { *kind = TOK_GREATAND; return 2; }
+        *kind = TOK_GREAT;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+enum tok_kind lexer_next(struct lexer *lx, struct token *tok) {
+    const char *s = lx->src;
+    size_t n = lx->len;
+    size_t p = lx->pos;
+
+    // Skip blanks and comments
+    for (;;) {
+        p += scan_blank(s + p, n - p);
+        if (p < n && s[p] == '#') {
+            const char *nl = memchr(s + p, '\n', n - p);
+            p = nl ? (size_t)(nl - s) : n;
+            continue;
+        }
+        break;
+    }
+
+    tok->flags = 0;
+    tok->io_number = -1;
+    tok->start = p;
+    tok->len = 0;
+
+    if (p >= n) {
+        lx->pos = p;
+        tok->kind = TOK_EOF;
+        return TOK_EOF;
+    }
+
+    size_t oplen = lex_operator(s, n, p, &tok->kind);
+    if (oplen) {
+        tok->len = oplen;
+        lx->pos = p + oplen;
+        return tok->kind;
+    }
+
+    // A word runs until an unquoted metacharacter. Runs of ordinary bytes
+    // are skipped many at a time; only quotes and escapes are looked at here.
+    unsigned flags = 0;
+    for (;;) {
+        p += scan_plain(s + p, n - p);
+        if (p >= n || is_meta(s[p])) break;
+
+        char c = s[p];
+        if (c == '\\') {
+            flags |= TOKF_QUOTED;
+            p += p + 1 < n ? 2 : 1;
+        } else if (c == '\'') {
+            flags |= TOKF_QUOTED;
+            const char *q = memchr(s + p + 1, '\'', n - p - 1);
+            if (!q) goto unterminated;
+            p = (size_t)(q - s) + 1;
+        } else if (c == '"') {
+            flags |= TOKF_QUOTED;
+            for (p++; p < n && s[p] != '"'; p++) {
+                if (s[p] == '\\' && p + 1 < n) p++;
+            }
+            if (p >= n) goto unterminated;
+            p++;
+        }
+    }
+
+    tok->kind = TOK_WORD;
+    tok->flags = flags;
+    tok->len = p - tok->start;
+
+    // An unquoted number right before '<' or '>' names the descriptor
+    if (!flags && p < n && (s[p] == '<' || s[p] == '>') && tok->len <= 4) {
+        int fd = 0;
+        size_t i = tok->start;
+        while (i < p && s[i] >= '0' && s[i] <= '9') fd = fd * 10 + (s[i++] - '0');
+        if (i == p) {
+            oplen = lex_operator(s, n, p, &tok->kind);
+            tok->io_number = fd;
+            tok->len += oplen;
+            p += oplen;
+        }
+    }
+
+    lx->pos = p;
+    return tok->kind;
+
+unterminated:
+    lx->error = "unexpected end of input while looking for matching quote";
+    lx->pos = n;
+    tok->kind = TOK_ERROR;
+    tok->len = n - tok->start;
+    return TOK_ERROR;
+}
+
+struct token *lex_all(struct arena *arena, const char *src, size_t len, size_t *ntok,
+                      const char **error) {
+    struct lexer lx;
+    struct token tok;
+    size_t count = 0;
+
+    // First pass only counts so the array is allocated once at its final size
+    *error = NULL;
+    lexer_init(&lx, src, len);
+    while (lexer_next(&lx, &tok) != TOK_EOF) {
+        if (tok.kind == TOK_ERROR) {
+            *error = lx.error;
+            return NULL;
+        }
+        count++;
+    }
+
+    struct token *toks = arena_alloc(arena, (count + 1) * sizeof(*toks));
+    if (!toks) return NULL;
+
+    lexer_init(&lx, src, len);
+    for (size_t i = 0; i <= count; i++) lexer_next(&lx, &toks[i]);
+
+    *ntok = count;
+    return toks;
+}
+
+size_t token_text(const char *src, const struct token *tok, char *dst) {
+    const char *s = src + tok->start;
+    size_t n = tok->len;
+
+    if (!(tok->flags & TOKF_QUOTED)) {
+        memcpy(dst, s, n);
+        dst[n] = '\0';
+        return n;
+    }
+
+    size_t o = 0;
+    for (size_t i = 0; i < n; i++) {
+        char c = s[i];
+        if (c == '\\') {
+            // Backslash-newline is a line continuation and disappears
+            if (i + 1 < n && s[++i] != '\n') dst[o++] = s[i];
+        } else if (c == '\'') {
+            while (++i < n && s[i] != '\'') dst[o++] = s[i];
+        } else if (c == '"') {
+            while (++i < n && s[i] != '"') {
+                // Inside double quotes only these characters can be escaped
+                if (s[i] == '\\' && i + 1 < n && s[i + 1] && strchr("\\\"$`\n", s[i + 1])) {
+                    if (s[++i] == '\n') continue;
+                }
+                dst[o++] = s[i];
+            }
+        } else {
+            dst[o++] = c;
+        }
+    }
+    dst[o] = '\0';
+    return o;
+}
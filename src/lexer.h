@@ -0,0 +1,103 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+enum tok_kind {
+    TOK_EOF,       // End of input
+    TOK_ERROR,     // Lexical error, e.g. an unterminated quote
+    TOK_WORD,      // A word, possibly containing quotes and escapes
+    TOK_NEWLINE,   // '\n'
+    TOK_PIPE,      // '|'
+    TOK_AMP,       // '&'
+    TOK_SEMI,      // ';'
+    TOK_AND_IF,    // '&&'
+    TOK_OR_IF,     // '||'
+    TOK_LPAREN,    // '('
+    TOK_RPAREN,    // ')'
+    TOK_LESS,      // '<'
+    TOK_GREAT,     // '>'
+    TOK_DGREAT,    // '>>'
+    TOK_LESSAND,   // '<&'
+    TOK_GREATAND,  // '>&', as in 2>&1
+    TOK_DLESS,     // '<<', a here-document
+    TOK_DLESSDASH, // '<<-', a here-document with leading tabs stripped
+    TOK_TLESS,     // '<<<', a here-string
+};
+
+/* The word contains quotes or backslashes and must go through token_text */
+#define TOKF_QUOTED 0x1
+
+/* A token is a span of the input; nothing is copied while lexing */
+struct token {
+    enum tok_kind kind;
+    unsigned flags;
+    int io_number;  // The 2 in "2>", or -1 when no descriptor was given
+    size_t start;   // Offset of the first byte in the input
+    size_t len;     // Length in bytes of the token in the input
+};
+
+struct lexer {
+    const char *src;
+    size_t len;
+    size_t pos;
+    const char *error;  // Message for the last TOK_ERROR
+};
+
+/**
+ * @brief Start lexing len bytes of src. The input does not need to be
+ * NUL-terminated and must stay valid while its tokens are in use.
+ *
+ * @param lx The lexer
+ * @param src The input
+ * @param len Number of bytes of input
+ */
+void lexer_init(struct lexer *lx, const char *src, size_t len);
+
+/**
+ * @brief Produce the next token in a single forward pass over the input.
+ * Blanks separate tokens and a '#' at the start of a word begins a comment
+ * that runs to the end of the line.
+ *
+ * @param lx The lexer
+ * @param tok Receives the token
+ * @return The kind of the token; TOK_EOF at the end, TOK_ERROR on error
+ */
+enum tok_kind lexer_next(struct lexer *lx, struct token *tok);
+
+/**
+ * @brief Lex the whole input into an array allocated from the arena.
+ * The array ends with a TOK_EOF token.
+ *
+ * @param arena The arena to allocate from
+ * @param src The input
+ * @param len Number of bytes of input
+ * @param ntok Receives the number of tokens, not counting TOK_EOF
+ * @param error Receives what is wrong on a lexical error, otherwise NULL
+ * @return The tokens, or NULL on a lexical error or allocation failure
+ */
+struct token *lex_all(struct arena *arena, const char *src, size_t len, size_t *ntok,
+                      const char **error);
+
+/**
+ * @brief Write the text of a token with quotes removed and escapes applied.
+ * dst must have room for tok->len + 1 bytes; the result is NUL-terminated.
+ *
+ * @param src The input the token came from
+ * @param tok The token
+ * @param dst Where to write the text
+ * @return The length of the text written, not counting the NUL
+ */
+size_t token_text(const char *src, const struct token *tok, char *dst);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
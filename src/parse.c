@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "parse.h"
+
+/* Initial number of stages allocated for a pipeline; doubled as needed */
+#define PARSE_MIN_STAGES 4
+
+/* Recursive-descent state over one line's tokens */
+struct parser {
+    struct arena *arena;
+    const char *src;
+    const struct token *toks;
+    size_t ntok;        // Tokens before the end of the line
+    size_t pos;
+    size_t nheredocs;   // Here-documents seen so far
+    bool syntax_error;  // A failure was a syntax error, not lack of memory
+};
+
+/* What ends a list: the line, a ')' or a '}' */
+enum closer { CLOSE_EOF, CLOSE_PAREN, CLOSE_BRACE };
+
+static const struct token eof_token = { .kind = TOK_EOF, .io_number = -1 };
+
+// Reports an operator the parser does not expect here
+static void unexpected(struct parser *p, const struct token *tok) {
+    p->syntax_error = true;
+    if (tok->kind == TOK_EOF) {
+        fprintf(stderr, "syntax error: unexpected end of line\n");
+    } else if (tok->kind == TOK_NEWLINE) {
+        fprintf(stderr, "syntax error near unexpected token `newline'\n");
+    } else {
+        fprintf(stderr, "syntax error near unexpected token `%.*s'\n",
+                (int)tok->len, p->src + tok->start);
+    }
+}
+
+static const struct token *peek(const struct parser *p) {
+    return p->pos < p->ntok ? &p->toks[p->pos] : &eof_token;
+}
+
+// Whether the next token is the unquoted word w, as reserved words must be
+static bool at_word(const struct parser *p, const char *w) {
+    const struct token *t = peek(p);
+    size_t n = strlen(w);
+    return t->kind == TOK_WORD && !(t->flags & TOKF_QUOTED) && t->len == n
+        && memcmp(p->src + t->start, w, n) == 0;
+}
+
+static bool at_close(const struct parser *p, enum closer c) {
+    switch (c) {
+    case CLOSE_PAREN: return peek(p)->kind == TOK_RPAREN;
+    case CLOSE_BRACE: return at_word(p, "}");
+    default:          return peek(p)->kind == TOK_EOF;
+    }
+}
+
+// Whether t ends a pipeline, so 'time' before it times nothing
+static bool ends_pipeline(const struct token *t) {
+    switch (t->kind) {
+    case TOK_EOF: case TOK_NEWLINE: case TOK_SEMI: case TOK_AMP:
+    case TOK_AND_IF: case TOK_OR_IF: case TOK_RPAREN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Reports whether kind is a redirection operator, and which
+static bool redir_kind_of(enum tok_kind kind, enum redir_kind *out) {
+    enum redir_kind k;
+    switch (kind) {
+    case TOK_LESS:     k = REDIR_IN; break;
+    case TOK_GREAT:    k = REDIR_OUT; break;
+    case TOK_DGREAT:   k = REDIR_APPEND; break;
+    case TOK_LESSAND:
+    case TOK_GREATAND: k = REDIR_DUP; break;
+    case TOK_TLESS:    k = REDIR_STRING; break;
+    case TOK_DLESS:
+    case TOK_DLESSDASH: k = REDIR_HEREDOC; break;
+    default:           return false;
+    }
+    if (out) *out = k;
+    return true;
+}
+
+// Fills in r from an operator and its word, copying the word's text to *buf
+static bool parse_redir(struct parser *p, const struct token *op, const struct token *w,
+                        enum redir_kind kind, struct redir *r, char **buf) {
+    bool input = op->kind != TOK_GREAT && op->kind != TOK_DGREAT && op->kind != TOK_GREATAND;
+    size_t len = token_text(p->src, w, *buf);
+    *r = (struct redir){
+        .kind = kind,
+        .fd = op->io_number >= 0 ? op->io_number : !input,
+        .src = -1,
+        .word = *buf,
+        .len = len,
+        .strip_tabs = op->kind == TOK_DLESSDASH,
+        .here_fd = -1,
+    };
+    if (kind == REDIR_STRING) {
+        (*buf)[r->len++] = '\n';
+        (*buf)[r->len] = '\0';
+    }
+    *buf += r->len + 1;
+
+    if (kind != REDIR_DUP) return true;
+    // The word of <& and >& is a descriptor number, or '-' to close
+    if (len == 1 && r->word[0] == '-') {
+        r->kind = REDIR_CLOSE;
+        return true;
+    }
+    if (len == 0 || len > 4 || strspn(r->word, "0123456789") != len) {
+        unexpected(p, w);
+        return false;
+    }
+    r->src = atoi(r->word);
+    return true;
+}
+
+
+// Parses the words and redirections of a simple command up to the next
+// operator, or with words false only the redirections after a group.
+// Everything is counted first so argv, the redirections and their text are
+// one allocation each.
+static bool parse_simple(struct parser *p, struct command *cmd, bool words) {
+    size_t nwords = 0;
+    size_t nredirs = 0;
+    size_t text = 0;
+    size_t end = p->pos;
+    for (; end < p->ntok; end++) {
+        const struct token *t = &p->toks[end];
+        if (t->kind == TOK_WORD && words) {
+            nwords++;
+            text += t->len + 1;
+        } else if (redir_kind_of(t->kind, NULL)) {
+            const struct token *w = end + 1 < p->ntok ? &p->toks[end + 1] : &eof_token;
+            if (w->kind != TOK_WORD) {
+                unexpected(p, w);
+                return false;
+            }
+            nredirs++;
+            // A here-string's text gets a newline appended
+            text += w->len + 2;
+            end++;
+        } else {
+            break;
+        }
+    }
+    if (words && nwords + nredirs == 0) {
+        unexpected(p, peek(p));
+        return false;
+    }
+
+    char **argv = arena_alloc(p->arena, (nwords + 1) * sizeof(char *));
+    struct redir *redirs = nredirs ? arena_alloc(p->arena, nredirs * sizeof(*redirs)) : NULL;
+    char *buf = text ? arena_alloc(p->arena, text) : NULL;
+    if (!argv || (nredirs && !redirs) || (text && !buf)) return false;
+
+    cmd->argv = argv;
+    cmd->redirs = redirs;
+    cmd->nredirs = nredirs;
+    for (size_t i = p->pos; i < end; i++) {
+        enum redir_kind kind;
+        if (redir_kind_of(p->toks[i].kind, &kind)) {
+            if (!parse_redir(p, &p->toks[i], &p->toks[i + 1], kind, redirs++, &buf)) {
+                return false;
+            }
+            if (kind == REDIR_HEREDOC) p->nheredocs++;
+            i++;
+        } else {
+            *argv++ = buf;
+            buf += token_text(p->src, &p->toks[i], buf) + 1;
+        }
+    }
+    *argv = NULL;
+    p->pos = end;
+    return true;
+}
+
+static struct node *parse_list(struct parser *p, enum closer c);
+
+// A simple command, or a ( ) or { } group with its redirections
+static bool parse_command(struct parser *p, struct command *cmd) {
+    if (at_word(p, "}")) {
+        unexpected(p, peek(p));
+        return false;
+    }
+    bool sub = peek(p)->kind == TOK_LPAREN;
+    if (!sub && !at_word(p, "{")) return parse_simple(p, cmd, true);
+
+    p->pos++;
+    struct node *body = parse_list(p, sub ? CLOSE_PAREN : CLOSE_BRACE);
+    if (!body) return false;
+    p->pos++;
+    if (!parse_simple(p, cmd, false)) return false;
+    cmd->body = body;
+    cmd->subshell = sub;
+    return true;
+}
+
+static struct pipeline *parse_pipe(struct parser *p) {
+    size_t heredocs = p->nheredocs;
+    struct pipeline *pl = arena_alloc(p->arena, sizeof(*pl));
+    if (!pl) return NULL;
+    *pl = (struct pipeline){0};
+
+    // A leading unquoted 'time' is a keyword, not a command
+    if (at_word(p, "time")) {
+        pl->timed = true;
+        p->pos++;
+        if (ends_pipeline(peek(p))) {
+            const struct token *t = &p->toks[p->pos - 1];
+            pl->text = p->src + t->start;
+            pl->textlen = t->len;
+            return pl;
+        }
+    }
+
+    size_t first = p->pos;
+    size_t cap = PARSE_MIN_STAGES;
+    struct command *stages = arena_alloc(p->arena, cap * sizeof(*stages));
+    if (!stages) return NULL;
+    for (;;) {
+        if (pl->nstages == cap) {
+            struct command *grown = arena_alloc(p->arena, 2 * cap * sizeof(*stages));
+            if (!grown) return NULL;
+            memcpy(grown, stages, cap * sizeof(*stages));
+            stages = grown;
+            cap *= 2;
+        }
+        struct command *cmd = &stages[pl->nstages++];
+        *cmd = (struct command){0};
+        if (!parse_command(p, cmd)) return NULL;
+        if (peek(p)->kind != TOK_PIPE) break;
+        p->pos++;
+    }
+
+    const struct token *last = &p->toks[p->pos - 1];
+    pl->stages = stages;
+    pl->text = p->src + p->toks[first].start;
+    pl->textlen = last->start + last->len - p->toks[first].start;
+    pl->nheredocs = p->nheredocs - heredocs;
+    return pl;
+}
+
+static struct node *new_node(struct parser *p, enum node_kind kind, struct node *left,
+                             struct node *right, struct pipeline *pl) {
+    struct node *n = arena_alloc(p->arena, sizeof(*n));
+    if (!n) return NULL;
+    *n = (struct node){ .kind = kind, .pl = pl, .left = left, .right = right };
+    n->nheredocs = pl ? pl->nheredocs : left->nheredocs + right->nheredocs;
+    return n;
+}
+
+// Pipelines joined by && and ||, which group to the left
+static struct node *parse_and_or(struct parser *p) {
+    struct pipeline *pl = parse_pipe(p);
+    struct node *left = pl ? new_node(p, NODE_PIPELINE, NULL, NULL, pl) : NULL;
+    while (left && (peek(p)->kind == TOK_AND_IF || peek(p)->kind == TOK_OR_IF)) {
+        enum node_kind kind = peek(p)->kind == TOK_AND_IF ? NODE_AND : NODE_OR;
+        p->pos++;
+        pl = parse_pipe(p);
+        struct node *right = pl ? new_node(p, NODE_PIPELINE, NULL, NULL, pl) : NULL;
+        left = right ? new_node(p, kind, left, right, NULL) : NULL;
+    }
+    return left;
+}
+
+// Marks the and-or list from token first up to the '&' to run in the
+// background. A single pipeline is flagged as it is; a longer list is put
+// in a ( ) group so it runs as one job.
+static struct node *background(struct parser *p, struct node *n, size_t first) {
+    if (n->kind == NODE_PIPELINE) {
+        n->pl->background = true;
+        return n;
+    }
+    struct pipeline *pl = arena_alloc(p->arena, sizeof(*pl));
+    struct command *cmd = arena_alloc(p->arena, sizeof(*cmd));
+    char **argv = arena_alloc(p->arena, sizeof(*argv));
+    if (!pl || !cmd || !argv) return NULL;
+    *argv = NULL;
+    *cmd = (struct command){ .argv = argv, .body = n, .subshell = true };
+
+    const struct token *last = &p->toks[p->pos - 1];
+    *pl = (struct pipeline){
+        .stages = cmd,
+        .nstages = 1,
+        .background = true,
+        .text = p->src + p->toks[first].start,
+        .textlen = last->start + last->len - p->toks[first].start,
+        .nheredocs = n->nheredocs,
+    };
+    return new_node(p, NODE_PIPELINE, NULL, NULL, pl);
+}
+
+// And-or lists separated by ';', '&' or newlines, up to the closer c,
+// which is left for the caller. A separator may also end the list.
+static struct node *parse_list(struct parser *p, enum closer c) {
+    struct node *list = NULL;
+    for (;;) {
+        size_t first = p->pos;
+        struct node *n = parse_and_or(p);
+        if (!n) return NULL;
+
+        const struct token *t = peek(p);
+        if (t->kind == TOK_AMP && !(n = background(p, n, first))) return NULL;
+        list = list ? new_node(p, NODE_SEQ, list, n, NULL) : n;
+        if (!list) return NULL;
+
+        if (t->kind == TOK_SEMI || t->kind == TOK_AMP || t->kind == TOK_NEWLINE) {
+            p->pos++;
+            if (at_close(p, c)) return list;
+        } else if (at_close(p, c)) {
+            return list;
+        } else {
+            unexpected(p, t);
+            return NULL;
+        }
+    }
+}
+
+// Lexes a line for parsing. Returns false for an empty line or a lexical
+// error, which is reported here.
+static bool parser_init(struct parser *p, struct arena *arena, const char *src, size_t len) {
+    *p = (struct parser){ .arena = arena, .src = src };
+    const char *error;
+    struct token *toks = lex_all(arena, src, len, &p->ntok, &error);
+    if (!toks) {
+        if (error) {
+            fprintf(stderr, "syntax error: %s\n", error);
+            p->syntax_error = true;
+        }
+        return false;
+    }
+
+    // A trailing newline is just the end of the command
+    while (p->ntok > 0 && toks[p->ntok - 1].kind == TOK_NEWLINE) p->ntok--;
+    p->toks = toks;
+    return p->ntok > 0;
+}
+
+struct node *parse_line(struct arena *arena, const char *src, size_t len,
+                        enum parse_status *status) {
+    struct parser p;
+    struct node *list = NULL;
+    enum parse_status st = PARSE_EMPTY;
+    if (parser_init(&p, arena, src, len)) {
+        list = parse_list(&p, CLOSE_EOF);
+        if (list) st = PARSE_OK;
+    }
+    // Without a tree or an empty line, either a syntax error was reported
+    // or an allocation failed
+    if (!list && (p.syntax_error || !p.toks || p.ntok > 0)) {
+        st = p.syntax_error ? PARSE_SYNTAX : PARSE_NOMEM;
+    }
+    if (status) *status = st;
+    return list;
+}
+
+static struct node *copy_node(struct arena *arena, const struct node *n);
+
+// Copies one stage, its words and redirections into the arena
+static bool copy_command(struct arena *arena, struct command *dst, const struct command *src) {
+    *dst = *src;
+    size_t argc = 0;
+    while (src->argv[argc]) argc++;
+    dst->argv = arena_alloc(arena, (argc + 1) * sizeof(char *));
+    if (!dst->argv) return false;
+    for (size_t i = 0; i < argc; i++) {
+        dst->argv[i] = arena_strdup(arena, src->argv[i]);
+        if (!dst->argv[i]) return false;
+    }
+    dst->argv[argc] = NULL;
+
+    if (src->nredirs) {
+        dst->redirs = arena_alloc(arena, src->nredirs * sizeof(*dst->redirs));
+        if (!dst->redirs) return false;
+        for (size_t k = 0; k < src->nredirs; k++) {
+            dst->redirs[k] = src->redirs[k];
+            dst->redirs[k].word = arena_strndup(arena, src->redirs[k].word, src->redirs[k].len);
+            if (!dst->redirs[k].word) return false;
+        }
+    }
+    return !src->body || (dst->body = copy_node(arena, src->body)) != NULL;
+}
+
+static struct pipeline *copy_pipeline(struct arena *arena, const struct pipeline *src) {
+    struct pipeline *pl = arena_alloc(arena, sizeof(*pl));
+    if (!pl) return NULL;
+    *pl = *src;
+    pl->stages = src->nstages ? arena_alloc(arena, src->nstages * sizeof(*pl->stages)) : NULL;
+    pl->text = arena_strndup(arena, src->text, src->textlen);
+    if ((src->nstages && !pl->stages) || !pl->text) return NULL;
+    for (size_t i = 0; i < src->nstages; i++) {
+        if (!copy_command(arena, &pl->stages[i], &src->stages[i])) return NULL;
+    }
+    return pl;
+}
+
+static struct node *copy_node(struct arena *arena, const struct node *n) {
+    struct node *c = arena_alloc(arena, sizeof(*c));
+    if (!c) return NULL;
+    *c = *n;
+    if (n->kind == NODE_PIPELINE) {
+        c->pl = copy_pipeline(arena, n->pl);
+        return c->pl ? c : NULL;
+    }
+    c->left = copy_node(arena, n->left);
+    c->right = copy_node(arena, n->right);
+    return c->left && c->right ? c : NULL;
+}
+
+struct node *parse_copy(struct arena *arena, const struct node *n) {
+    return copy_node(arena, n);
+}
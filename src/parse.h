@@ -0,0 +1,97 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+#include "redir.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct node;
+
+/* How parsing a line went */
+enum parse_status {
+    PARSE_OK,       // A tree was returned
+    PARSE_EMPTY,    // Nothing to run, such as a blank line or a comment
+    PARSE_SYNTAX,   // A syntax error, already reported on stderr
+    PARSE_NOMEM,    // Memory ran out
+};
+
+/* One stage of a pipeline: a simple command, or a ( ) or { } group */
+struct command {
+    char **argv;            // Empty for a group, or a stage that is only redirections
+    struct redir *redirs;   // In the order written
+    size_t nredirs;
+    struct node *body;      // The list inside ( ) or { }, or NULL
+    bool subshell;          // body runs in a child: ( ) rather than { }
+};
+
+/* Commands connected by '|' */
+struct pipeline {
+    struct command *stages;
+    size_t nstages;
+    bool background;    // Ended with '&'
+    bool timed;         // Started with the 'time' keyword
+    size_t nheredocs;   // Here-documents whose bodies follow the line
+    const char *text;   // The pipeline's source text, not NUL-terminated
+    size_t textlen;
+};
+
+enum node_kind {
+    NODE_PIPELINE,  // Run pl
+    NODE_SEQ,       // left ; right
+    NODE_AND,       // left && right
+    NODE_OR,        // left || right
+};
+
+/* A command list as a tree. A list ended by '&' is a background pipeline;
+ * when it is more than one pipeline it becomes a ( ) group run that way. */
+struct node {
+    enum node_kind kind;
+    struct pipeline *pl;    // NODE_PIPELINE
+    struct node *left;      // The other kinds
+    struct node *right;
+    size_t nheredocs;       // Here-documents anywhere below
+};
+
+/**
+ * @brief Parse a whole command line: pipelines joined by ';', '&', '&&' and
+ * '||', with ( ) and { } grouping. '&&' and '||' bind tighter than ';' and
+ * '&', and associate to the left. A pipeline may start with the 'time'
+ * keyword; a bare 'time' yields a timed pipeline with no stages. Words have
+ * their quotes and escapes removed, and redirections may appear anywhere in
+ * a stage and are taken out of its argv. Here-documents are only recorded;
+ * their bodies are read afterwards with heredoc_read. Everything is
+ * allocated from the arena.
+ *
+ * @param arena The arena to allocate from
+ * @param src The command line
+ * @param len Number of bytes in the command line
+ * @param status Receives why there is no tree, or PARSE_OK; may be NULL
+ * @return The root of the tree, or NULL if the line is empty or has a
+ * syntax error (which is reported on stderr)
+ */
+struct node *parse_line(struct arena *arena, const char *src, size_t len,
+                        enum parse_status *status);
+
+/**
+ * @brief Copy a parsed tree, with every word, redirection and pipeline text
+ * it points to, into another arena, so it no longer refers to the line it
+ * was parsed from or the arena it was parsed into.
+ *
+ * @param arena The arena to copy into
+ * @param n The root of the tree
+ * @return The copy, or NULL if memory ran out (the arena keeps whatever was
+ * already copied)
+ */
+struct node *parse_copy(struct arena *arena, const struct node *n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "proc.h"
+
+// posix_spawn_file_actions_addtcsetpgrp_np appeared in glibc 2.35
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_SPAWN_TCSETPGRP 1
+#else
+#define HAVE_SPAWN_TCSETPGRP 0
+#endif
+
+extern char **environ;
+
+// Runs executables that are not binaries and have no #! line
+#define SHELL_PATH "/bin/sh"
+
+// Signals the shell ignores that every child must get back
+static const int job_signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGPIPE };
+
+void child_setup(pid_t pgid, int tty, int in_fd, int out_fd) {
+    pid_t child = getpid();
+    if (pgid >= 0) setpgid(child, pgid ? pgid : child);
+    if (tty >= 0) tcsetpgrp(tty, pgid > 0 ? pgid : child);
+
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++) {
+        signal(job_signals[i], SIG_DFL);
+    }
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+
+    if (in_fd >= 0 && in_fd != STDIN_FILENO) dup2(in_fd, STDIN_FILENO);
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO) dup2(out_fd, STDOUT_FILENO);
+}
+
+// Arguments for running path as a shell script: "/bin/sh path args...",
+// which is how execvp treats an executable that the kernel rejects with
+// ENOEXEC (one without a #! line). NULL if memory ran out; free the result.
+static char **script_argv(const char *path, char **argv) {
+    size_t argc = 0;
+    while (argv[argc]) argc++;
+    char **sh_argv = malloc((argc + 2) * sizeof(*sh_argv));
+    if (!sh_argv) return NULL;
+    sh_argv[0] = (char *)SHELL_PATH;
+    sh_argv[1] = (char *)path;
+    // The script's own arguments follow; argv[0] is replaced by its path
+    for (size_t i = 1; i <= argc; i++) sh_argv[i + 1] = argv[i];
+    return sh_argv;
+}
+
+// Fallback: fork and do the process group / terminal setup by hand
+static pid_t spawn_fork(const char *path, char **argv, pid_t pgid, int tty,
+                        int in_fd, int out_fd, const struct redirs *rs) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        child_setup(pgid, tty, in_fd, out_fd);
+        if (rs && redir_apply(rs) != 0) _exit(1);
+        execve(path, argv, environ);
+        if (errno == ENOEXEC) {
+            char **sh_argv = script_argv(path, argv);
+            if (sh_argv) execve(SHELL_PATH, sh_argv, environ);
+        }
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+pid_t spawn_cmd(const char *path, char **argv, pid_t pgid, int tty,
+                int in_fd, int out_fd, const struct redirs *rs) {
+    if (!HAVE_SPAWN_TCSETPGRP && tty >= 0) {
+        return spawn_fork(path, argv, pgid, tty, in_fd, out_fd, rs);
+    }
+
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    sigset_t defaults, none;
+
+    sigemptyset(&defaults);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++) {
+        sigaddset(&defaults, job_signals[i]);
+    }
+    sigemptyset(&none);
+
+    posix_spawnattr_init(&attr);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (pgid >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, pgid);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &none);
+
+    posix_spawn_file_actions_init(&fa);
+#if HAVE_SPAWN_TCSETPGRP
+    // Runs in the child after setpgid with all signals still blocked, so the
+    // child cannot be stopped by SIGTTOU while taking the terminal
+    if (tty >= 0) posix_spawn_file_actions_addtcsetpgrp_np(&fa, tty);
+#endif
+    // Pipe ends are close-on-exec; the dup2'd copies are not
+    if (in_fd >= 0 && in_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&fa, in_fd, STDIN_FILENO);
+    }
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&fa, out_fd, STDOUT_FILENO);
+    }
+    // Redirections go after the pipes, so 2>&1 in a pipeline means the pipe.
+    // Their files are already open in the shell, which can name the one
+    // that failed; the child only copies descriptors.
+    for (size_t i = 0; rs && i < rs->n; i++) {
+        const struct redir *r = &rs->list[i];
+        if (r->kind == REDIR_CLOSE) {
+            posix_spawn_file_actions_addclose(&fa, r->fd);
+        } else {
+            posix_spawn_file_actions_adddup2(&fa, r->kind == REDIR_DUP ? r->src : rs->fds[i],
+                                             r->fd);
+        }
+    }
+
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &fa, &attr, argv, environ);
+    if (err == ENOEXEC) {
+        char **sh_argv = script_argv(path, argv);
+        err = sh_argv ? posix_spawn(&pid, SHELL_PATH, &fa, &attr, sh_argv, environ) : ENOMEM;
+        free(sh_argv);
+    }
+
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
@@ -0,0 +1,57 @@
+#ifndef PROC_H
+#define PROC_H
+
+#include <sys/types.h>
+#include "redir.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Start the program at path as a child process with arguments argv.
+ * The child is placed in process group pgid, in a new group it leads when
+ * pgid is 0, or left in the shell's group when pgid is -1 (no job control).
+ * When tty is a valid descriptor the child's group is also made the
+ * foreground process group of that terminal. Job-control signals are reset to
+ * their defaults and the signal mask is cleared in the child. in_fd and
+ * out_fd, when not -1, become the child's standard input and output, and
+ * then the redirections in rs are applied on top, as spawn file actions.
+ * An executable file the kernel cannot run (ENOEXEC, e.g. a script with no
+ * #! line) is run with /bin/sh, as execvp does.
+ *
+ * The fast path is posix_spawn, which glibc implements with
+ * clone(CLONE_VM|CLONE_VFORK) so the shell's page tables are never copied.
+ * fork() is only used when the C library cannot hand the terminal to the
+ * child from inside the spawn.
+ *
+ * @param path Path of the program to exec, usually from cmd_hash_lookup
+ * @param argv NULL-terminated argument vector
+ * @param pgid Process group to join, 0 for a new group, -1 for the shell's
+ * @param tty Terminal to hand to the child, or -1 to leave it alone
+ * @param in_fd Descriptor to use as stdin, or -1 to inherit the shell's
+ * @param out_fd Descriptor to use as stdout, or -1 to inherit the shell's
+ * @param rs Redirections opened with redir_open, or NULL
+ * @return The child's pid, or -1 with errno set if it could not be started
+ */
+pid_t spawn_cmd(const char *path, char **argv, pid_t pgid, int tty,
+                int in_fd, int out_fd, const struct redirs *rs);
+
+/**
+ * @brief Child-side setup shared by every launch path that has to fork:
+ * join the process group, take the terminal, reset job-control signals and
+ * wire up stdin/stdout. Only call this in a freshly forked child.
+ *
+ * @param pgid Process group to join, 0 for a new group, -1 for the shell's
+ * @param tty Terminal to take, or -1
+ * @param in_fd Descriptor to use as stdin, or -1
+ * @param out_fd Descriptor to use as stdout, or -1
+ */
+void child_setup(pid_t pgid, int tty, int in_fd, int out_fd);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
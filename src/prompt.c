@@ -0,0 +1,164 @@
+#include <limits.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "prompt.h"
+
+void prompt_init(struct prompt *p) {
+    memset(p, 0, sizeof(*p));
+}
+
+void prompt_destroy(struct prompt *p) {
+    free(p->tmpl);
+    free(p->text);
+    free(p->user);
+    free(p->host);
+    prompt_init(p);
+}
+
+// Works out which inputs a template depends on
+static unsigned template_uses(const char *tmpl) {
+    unsigned uses = 0;
+    for (const char *c = tmpl; *c; c++) {
+        if (*c != '\\' || !c[1]) continue;
+        switch (*++c) {
+        case 'w': case 'W': uses |= PROMPT_USES_CWD; break;
+        case '?': uses |= PROMPT_USES_STATUS; break;
+        case 'j': uses |= PROMPT_USES_JOBS; break;
+        }
+    }
+    return uses;
+}
+
+// Appends n bytes to the rendered text, growing it as needed
+static void put(struct prompt *p, size_t *len, const char *s, size_t n) {
+    if (*len + n + 1 > p->cap) {
+        size_t cap = p->cap ? p->cap : 64;
+        while (*len + n + 1 > cap) cap *= 2;
+        char *text = realloc(p->text, cap);
+        if (!text) return;
+        p->text = text;
+        p->cap = cap;
+    }
+    memcpy(p->text + *len, s, n);
+    *len += n;
+    p->text[*len] = '\0';
+}
+
+static void put_str(struct prompt *p, size_t *len, const char *s) {
+    put(p, len, s, strlen(s));
+}
+
+static const char *user_name(struct prompt *p) {
+    if (!p->user) {
+        struct passwd *pw = getpwuid(getuid());
+        const char *name = pw ? pw->pw_name : getenv("USER");
+        p->user = strdup(name ? name : "");
+    }
+    return p->user ? p->user : "";
+}
+
+static const char *host_name(struct prompt *p) {
+    if (!p->host) {
+        char buf[256] = "";
+        gethostname(buf, sizeof(buf) - 1);
+        p->host = strdup(buf);
+    }
+    return p->host ? p->host : "";
+}
+
+// Appends the working directory, with $HOME shown as ~
+static void put_cwd(struct prompt *p, size_t *len, bool basename_only) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        put_str(p, len, "?");
+        return;
+    }
+
+    const char *home = getenv("HOME");
+    size_t hlen = home ? strlen(home) : 0;
+    bool in_home = hlen > 1 && strncmp(cwd, home, hlen) == 0 &&
+                   (cwd[hlen] == '/' || cwd[hlen] == '\0');
+
+    if (basename_only) {
+        if (in_home && cwd[hlen] == '\0') {
+            put_str(p, len, "~");
+        } else {
+            const char *slash = strrchr(cwd, '/');
+            put_str(p, len, slash && slash[1] ? slash + 1 : cwd);
+        }
+    } else if (in_home) {
+        put_str(p, len, "~");
+        put_str(p, len, cwd + hlen);
+    } else {
+        put_str(p, len, cwd);
+    }
+}
+
+static void render(struct prompt *p, const char *tmpl, const struct prompt_inputs *in) {
+    size_t len = 0;
+    put(p, &len, "", 0);
+
+    for (const char *c = tmpl; *c; c++) {
+        const char *run = c;
+        while (*c && *c != '\\') c++;
+        put(p, &len, run, (size_t)(c - run));
+        if (!*c) break;
+
+        char num[32];
+        switch (*++c) {
+        case 'w': put_cwd(p, &len, false); break;
+        case 'W': put_cwd(p, &len, true); break;
+        case 'u': put_str(p, &len, user_name(p)); break;
+        case 'h': put(p, &len, host_name(p), strcspn(host_name(p), ".")); break;
+        case 'H': put_str(p, &len, host_name(p)); break;
+        case '?':
+            snprintf(num, sizeof(num), "%d", in->status);
+            put_str(p, &len, num);
+            break;
+        case 'j':
+            snprintf(num, sizeof(num), "%zu", in->njobs);
+            put_str(p, &len, num);
+            break;
+        case '$': put_str(p, &len, geteuid() == 0 ? "#" : "$"); break;
+        case 'n': put_str(p, &len, "\n"); break;
+        case 'e': put_str(p, &len, "\033"); break;
+        // Bracket non-printing text so readline can measure the prompt
+        case '[': put_str(p, &len, "\001"); break;
+        case ']': put_str(p, &len, "\002"); break;
+        case '\\': put_str(p, &len, "\\"); break;
+        case '\0': put_str(p, &len, "\\"); c--; break;
+        default:
+            // Unknown escapes are shown as written
+            put(p, &len, c - 1, 2);
+            break;
+        }
+    }
+    p->renders++;
+}
+
+const char *prompt_render(struct prompt *p, const char *tmpl, const struct prompt_inputs *in) {
+    // A new template is the only time anything is allocated
+    if (!p->tmpl || strcmp(p->tmpl, tmpl) != 0) {
+        char *copy = strdup(tmpl);
+        if (!copy) return tmpl;
+        free(p->tmpl);
+        p->tmpl = copy;
+        p->uses = template_uses(tmpl);
+        p->valid = false;
+    }
+
+    if (p->valid &&
+        (!(p->uses & PROMPT_USES_CWD) || p->in.cwd_gen == in->cwd_gen) &&
+        (!(p->uses & PROMPT_USES_STATUS) || p->in.status == in->status) &&
+        (!(p->uses & PROMPT_USES_JOBS) || p->in.njobs == in->njobs)) {
+        return p->text;
+    }
+
+    render(p, tmpl, in);
+    p->in = *in;
+    p->valid = p->text != NULL;
+    return p->text ? p->text : tmpl;
+}
@@ -0,0 +1,69 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Which changing inputs a prompt template refers to */
+#define PROMPT_USES_CWD    0x1
+#define PROMPT_USES_STATUS 0x2
+#define PROMPT_USES_JOBS   0x4
+
+/* Shell state a prompt can show; compared against the cached copy */
+struct prompt_inputs {
+    unsigned long cwd_gen;  // Bumped whenever the working directory changes
+    int status;             // Exit status of the last command
+    size_t njobs;           // Number of jobs in the job table
+};
+
+struct prompt {
+    char *tmpl;             // Template the cached text was rendered from
+    unsigned uses;          // PROMPT_USES_* flags for tmpl
+    struct prompt_inputs in;// Inputs the cached text was rendered with
+    bool valid;
+    char *text;             // The rendered prompt
+    size_t cap;
+    unsigned long renders;  // How many times the text was rebuilt
+    char *user;             // Looked up once; neither changes while we run
+    char *host;
+};
+
+/**
+ * @brief Initialize an empty prompt cache.
+ *
+ * @param p The cache
+ */
+void prompt_init(struct prompt *p);
+
+/**
+ * @brief Free the cached template and text.
+ *
+ * @param p The cache
+ */
+void prompt_destroy(struct prompt *p);
+
+/**
+ * @brief Render tmpl, or return the cached text if neither the template nor
+ * any input it refers to has changed since the last call. Supported escapes
+ * are \w (cwd, $HOME as ~), \W (last cwd component), \u (user), \h (host up
+ * to the first '.'), \H (full host), \? (last status), \j (job count),
+ * \$ ('#' for root, else '$'), \n, \e (escape), \[ and \] (around
+ * non-printing sequences such as colors) and \\.
+ *
+ * @param p The cache
+ * @param tmpl The prompt template
+ * @param in Current values of the inputs
+ * @return The prompt, owned by the cache and valid until the next call
+ */
+const char *prompt_render(struct prompt *p, const char *tmpl, const struct prompt_inputs *in);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "redir.h"
+
+// A descriptor holding len bytes of text to read: a pipe when the text fits
+// in one atomic write, which can never block, otherwise a memfd
+static int open_here(const char *text, size_t len) {
+    if (len <= PIPE_BUF) {
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) < 0) return -1;
+        ssize_t w = write(p[1], text, len);
+        int err = errno;
+        close(p[1]);
+        if (w != (ssize_t)len) {
+            close(p[0]);
+            errno = err;
+            return -1;
+        }
+        return p[0];
+    }
+
+    int fd = memfd_create("here-string", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    for (size_t off = 0; off < len;) {
+        ssize_t w = write(fd, text + off, len - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// Opens what one redirection reads or writes. min is where copies of
+// existing descriptors are placed.
+static int open_one(const struct redir *r, int min) {
+    switch (r->kind) {
+    case REDIR_IN:
+        return open(r->word, O_RDONLY | O_CLOEXEC);
+    case REDIR_OUT:
+        return open(r->word, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    case REDIR_APPEND:
+        return open(r->word, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    case REDIR_STRING:
+        return open_here(r->word, r->len);
+    case REDIR_HEREDOC:
+        // A body that was never read is empty
+        return r->here_fd >= 0 ? fcntl(r->here_fd, F_DUPFD_CLOEXEC, min) : open_here("", 0);
+    default:
+        return -1;
+    }
+}
+
+int redir_open(struct redirs *rs, const struct redir *list, size_t n,
+               struct arena *arena) {
+    rs->list = list;
+    rs->n = 0;
+    rs->fds = n ? arena_alloc(arena, n * sizeof(*rs->fds)) : NULL;
+    if (n && !rs->fds) return -1;
+
+    // Every descriptor the command names, as a target or a source
+    rs->max_fd = STDERR_FILENO;
+    for (size_t i = 0; i < n; i++) {
+        if (list[i].fd > rs->max_fd) rs->max_fd = list[i].fd;
+        if (list[i].src > rs->max_fd) rs->max_fd = list[i].src;
+    }
+
+    int min = rs->max_fd < REDIR_FD_MIN ? REDIR_FD_MIN : rs->max_fd + 1;
+    for (size_t i = 0; i < n; i++) {
+        rs->fds[i] = -1;
+        rs->n = i + 1;
+        if (list[i].kind == REDIR_DUP || list[i].kind == REDIR_CLOSE) continue;
+
+        int fd = open_one(&list[i], min);
+        // Keep clear of the descriptors being set up, or one redirection
+        // could overwrite the file another is about to copy from
+        if (fd >= 0 && fd <= rs->max_fd) {
+            int high = fcntl(fd, F_DUPFD_CLOEXEC, min);
+            close(fd);
+            fd = high;
+        }
+        if (fd < 0) {
+            const char *name = list[i].kind == REDIR_STRING ? "here-string"
+                             : list[i].kind == REDIR_HEREDOC ? "here-document"
+                             : list[i].word;
+            fprintf(stderr, "%s: %s\n", name, strerror(errno));
+            redir_close(rs);
+            return -1;
+        }
+        rs->fds[i] = fd;
+    }
+    return 0;
+}
+
+void redir_close(struct redirs *rs) {
+    for (size_t i = 0; i < rs->n; i++) {
+        if (rs->fds[i] >= 0) close(rs->fds[i]);
+        rs->fds[i] = -1;
+    }
+}
+
+int redir_apply(const struct redirs *rs) {
+    for (size_t i = 0; i < rs->n; i++) {
+        const struct redir *r = &rs->list[i];
+        if (r->kind == REDIR_CLOSE) {
+            close(r->fd);
+            continue;
+        }
+        int from = r->kind == REDIR_DUP ? r->src : rs->fds[i];
+        // dup2 onto itself succeeds without checking, so test the source
+        int ok = from == r->fd ? fcntl(from, F_GETFD) : dup2(from, r->fd);
+        if (ok < 0) {
+            fprintf(stderr, "%d: %s\n", from, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int *redir_save(const struct redirs *rs, struct arena *arena) {
+    int *saved = arena_alloc(arena, (rs->n + 1) * sizeof(*saved));
+    if (!saved) return NULL;
+    int min = rs->max_fd < REDIR_FD_MIN ? REDIR_FD_MIN : rs->max_fd + 1;
+    for (size_t i = 0; i < rs->n; i++) {
+        // EBADF: the descriptor was not open, and will be closed again
+        saved[i] = fcntl(rs->list[i].fd, F_DUPFD_CLOEXEC, min);
+    }
+    return saved;
+}
+
+void redir_restore(const struct redirs *rs, int *saved) {
+    // Newest first, so a descriptor redirected twice gets its original back
+    for (size_t i = rs->n; i-- > 0;) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], rs->list[i].fd);
+            close(saved[i]);
+        } else {
+            close(rs->list[i].fd);
+        }
+    }
+}
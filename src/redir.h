@@ -0,0 +1,105 @@
+#ifndef REDIR_H
+#define REDIR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Descriptors the shell opens for redirections are moved at least this high
+ * when they could collide with a descriptor the command names, as in bash */
+#define REDIR_FD_MIN 10
+
+enum redir_kind {
+    REDIR_IN,       // n<file
+    REDIR_OUT,      // n>file
+    REDIR_APPEND,   // n>>file
+    REDIR_DUP,      // n<&m or n>&m
+    REDIR_CLOSE,    // n<&- or n>&-
+    REDIR_STRING,   // n<<<word
+    REDIR_HEREDOC,  // n<<word or n<<-word
+};
+
+/* One redirection as parsed; never changed by running it */
+struct redir {
+    enum redir_kind kind;
+    int fd;             // The descriptor redirected
+    int src;            // REDIR_DUP: the descriptor copied
+    const char *word;   // File name, here-string text or here-document delimiter
+    size_t len;         // Length of word
+    bool strip_tabs;    // <<-: leading tabs are removed from the body
+    int here_fd;        // Here-document body, once read; see heredoc_read
+};
+
+/* A command's redirections, opened and ready to apply */
+struct redirs {
+    const struct redir *list;
+    size_t n;
+    int *fds;           // Close-on-exec descriptor opened for each, or -1
+    int max_fd;         // Highest descriptor the redirections name
+};
+
+/**
+ * @brief Open everything a command's redirections need: files, a pipe or
+ * memfd holding each here-string, and a copy of each here-document's
+ * descriptor (the original stays with the parse). Every descriptor is opened
+ * close-on-exec, so none leaks into a child unless it is dup2'd into place.
+ * The first failure is reported on stderr as "name: reason" and anything
+ * already opened is closed again.
+ *
+ * @param rs Receives the opened redirections
+ * @param list The command's redirections
+ * @param n Number of redirections
+ * @param arena The arena to allocate from
+ * @return 0 on success, -1 on failure
+ */
+int redir_open(struct redirs *rs, const struct redir *list, size_t n,
+               struct arena *arena);
+
+/**
+ * @brief Close the descriptors redir_open opened. Safe to call twice.
+ *
+ * @param rs The opened redirections
+ */
+void redir_close(struct redirs *rs);
+
+/**
+ * @brief Apply the redirections to the calling process with dup2 and close,
+ * in order. Only call this in a child, or between redir_save and
+ * redir_restore.
+ *
+ * @param rs The opened redirections
+ * @return 0 on success, -1 if a descriptor could not be copied (reported on
+ * stderr)
+ */
+int redir_apply(const struct redirs *rs);
+
+/**
+ * @brief Remember, close-on-exec and out of the way, every descriptor the
+ * redirections are about to replace, so a builtin can run redirected inside
+ * the shell.
+ *
+ * @param rs The opened redirections
+ * @param arena The arena to allocate from
+ * @return One saved descriptor per redirection (-1 where the descriptor was
+ * not open), or NULL if memory ran out
+ */
+int *redir_save(const struct redirs *rs, struct arena *arena);
+
+/**
+ * @brief Put back the descriptors saved by redir_save and close the copies.
+ *
+ * @param rs The opened redirections
+ * @param saved What redir_save returned
+ */
+void redir_restore(const struct redirs *rs, int *saved);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
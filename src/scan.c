@@ -0,0 +1,225 @@
+#include <stdint.h>
+#include "scan.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SCAN_SSE2 1
+#else
+#define HAVE_SCAN_SSE2 0
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SCAN_AVX2 1
+#else
+#define HAVE_SCAN_AVX2 0
+#endif
+
+#define CLS_BLANK   0x1
+#define CLS_SPACE   0x2
+#define CLS_SPECIAL 0x4
+
+// Byte classes for the scalar path; no locale lookups
+static const uint8_t byte_class[256] = {
+    ['\t'] = CLS_BLANK | CLS_SPACE | CLS_SPECIAL,
+    ['\n'] = CLS_SPACE | CLS_SPECIAL,
+    ['\v'] = CLS_SPACE,
+    ['\f'] = CLS_SPACE,
+    ['\r'] = CLS_SPACE,
+    [' ']  = CLS_BLANK | CLS_SPACE | CLS_SPECIAL,
+    ['|']  = CLS_SPECIAL,
+    ['&']  = CLS_SPECIAL,
+    [';']  = CLS_SPECIAL,
+    ['<']  = CLS_SPECIAL,
+    ['>']  = CLS_SPECIAL,
+    ['(']  = CLS_SPECIAL,
+    [')']  = CLS_SPECIAL,
+    ['\''] = CLS_SPECIAL,
+    ['"']  = CLS_SPECIAL,
+    ['\\'] = CLS_SPECIAL,
+};
+
+// Scalar: length of the prefix whose bytes all have class bit cls
+static size_t scalar_span(const char *s, size_t n, uint8_t cls) {
+    size_t i = 0;
+    while (i < n && (byte_class[(unsigned char)s[i]] & cls)) i++;
+    return i;
+}
+
+// Scalar: length of the prefix whose bytes all lack class bit cls
+static size_t scalar_cspan(const char *s, size_t n, uint8_t cls) {
+    size_t i = 0;
+    while (i < n && !(byte_class[(unsigned char)s[i]] & cls)) i++;
+    return i;
+}
+
+static size_t plain_scalar(const char *s, size_t n) { return scalar_cspan(s, n, CLS_SPECIAL); }
+static size_t blank_scalar(const char *s, size_t n) { return scalar_span(s, n, CLS_BLANK); }
+static size_t space_scalar(const char *s, size_t n) { return scalar_span(s, n, CLS_SPACE); }
+
+#if HAVE_SCAN_SSE2
+// Each helper returns a mask with 0xff in every lane that is in the set
+static inline __m128i sse2_special(__m128i v) {
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+}
+
+static inline __m128i sse2_blank(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+}
+
+// '\t'..'\r' are 9..13; bytes >= 0x80 are negative and fall outside
+static inline __m128i sse2_space(__m128i v) {
+    __m128i range = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(8)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8(14)));
+    return _mm_or_si128(range, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+// Finds the first lane where the set membership equals want
+#define SSE2_SCAN(name, classify, want, tail)                              \
+    static size_t name(const char *s, size_t n) {                          \
+        size_t i = 0;                                                      \
+        for (; i + 16 <= n; i += 16) {                                     \
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i));         \
+            unsigned m = (unsigned)_mm_movemask_epi8(classify(v));         \
+            if (!(want)) m = ~m & 0xffff;                                  \
+            if (m) return i + (size_t)__builtin_ctz(m);                    \
+        }                                                                  \
+        return i + tail(s + i, n - i);                                     \
+    }
+
+SSE2_SCAN(plain_sse2, sse2_special, 1, plain_scalar)
+SSE2_SCAN(blank_sse2, sse2_blank, 0, blank_scalar)
+SSE2_SCAN(space_sse2, sse2_space, 0, space_scalar)
+#endif
+
+#if HAVE_SCAN_AVX2
+#define AVX2_FN __attribute__((target("avx2")))
+
+static inline AVX2_FN __m256i avx2_special(__m256i v) {
+    __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+}
+
+static inline AVX2_FN __m256i avx2_blank(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+}
+
+static inline AVX2_FN __m256i avx2_space(__m256i v) {
+    __m256i range = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(8)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8(14), v));
+    return _mm256_or_si256(range, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+#define AVX2_SCAN(name, classify, want, tail)                              \
+    static AVX2_FN size_t name(const char *s, size_t n) {                  \
+        size_t i = 0;                                                      \
+        for (; i + 32 <= n; i += 32) {                                     \
+            __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));      \
+            unsigned m = (unsigned)_mm256_movemask_epi8(classify(v));      \
+            if (!(want)) m = ~m;                                           \
+            if (m) return i + (size_t)__builtin_ctz(m);                    \
+        }                                                                  \
+        return i + tail(s + i, n - i);                                     \
+    }
+
+AVX2_SCAN(plain_avx2, avx2_special, 1, plain_scalar)
+AVX2_SCAN(blank_avx2, avx2_blank, 0, blank_scalar)
+AVX2_SCAN(space_avx2, avx2_space, 0, space_scalar)
+#endif
+
+typedef size_t (*scan_fn)(const char *, size_t);
+
+struct scan_ops {
+    scan_fn plain;
+    scan_fn blank;
+    scan_fn space;
+};
+
+static const struct scan_ops scalar_ops = { plain_scalar, blank_scalar, space_scalar };
+#if HAVE_SCAN_SSE2
+static const struct scan_ops sse2_ops = { plain_sse2, blank_sse2, space_sse2 };
+#endif
+#if HAVE_SCAN_AVX2
+static const struct scan_ops avx2_ops = { plain_avx2, blank_avx2, space_avx2 };
+#endif
+
+// NULL until the first scan picks the best implementation
+static const struct scan_ops *ops;
+
+enum scan_impl scan_best_impl(void) {
+#if HAVE_SCAN_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SCAN_AVX2;
+#endif
+#if HAVE_SCAN_SSE2
+    return SCAN_SSE2;
+#else
+    return SCAN_SCALAR;
+#endif
+}
+
+int scan_set_impl(enum scan_impl impl) {
+    switch (impl) {
+    case SCAN_SCALAR:
+        ops = &scalar_ops;
+        return 0;
+    case SCAN_SSE2:
+#if HAVE_SCAN_SSE2
+        ops = &sse2_ops;
+        return 0;
+#else
+        return -1;
+#endif
+    case SCAN_AVX2:
+#if HAVE_SCAN_AVX2
+        if (scan_best_impl() != SCAN_AVX2) return -1;
+        ops = &avx2_ops;
+        return 0;
+#else
+        return -1;
+#endif
+    }
+    return -1;
+}
+
+static const struct scan_ops *get_ops(void) {
+    if (!ops) scan_set_impl(scan_best_impl());
+    return ops;
+}
+
+size_t scan_plain(const char *s, size_t n) {
+    return get_ops()->plain(s, n);
+}
+
+size_t scan_blank(const char *s, size_t n) {
+    return get_ops()->blank(s, n);
+}
+
+size_t scan_space(const char *s, size_t n) {
+    return get_ops()->space(s, n);
+}
@@ -0,0 +1,66 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Byte classifiers, from slowest to fastest */
+enum scan_impl {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+};
+
+/**
+ * @brief The fastest classifier this CPU supports, detected with cpuid.
+ *
+ * @return The implementation used by default
+ */
+enum scan_impl scan_best_impl(void);
+
+/**
+ * @brief Force a classifier, e.g. to compare implementations in tests.
+ *
+ * @param impl The implementation to use from now on
+ * @return 0 on success, -1 if the CPU or build does not support impl
+ */
+int scan_set_impl(enum scan_impl impl);
+
+/**
+ * @brief Length of the prefix of s made of bytes that can continue an
+ * unquoted word, i.e. none of blank, newline, | & ; < > ( ) ' " or backslash.
+ *
+ * @param s The bytes to scan (need not be NUL-terminated)
+ * @param n Number of bytes
+ * @return Offset of the first special byte, or n if there is none
+ */
+size_t scan_plain(const char *s, size_t n);
+
+/**
+ * @brief Length of the prefix of s made of blanks (space and tab).
+ *
+ * @param s The bytes to scan
+ * @param n Number of bytes
+ * @return Offset of the first non-blank byte, or n
+ */
+size_t scan_blank(const char *s, size_t n);
+
+/**
+ * @brief Length of the prefix of s made of whitespace as isspace() defines
+ * it in the C locale (space, \t, \n, \v, \f, \r).
+ *
+ * @param s The bytes to scan
+ * @param n Number of bytes
+ * @return Offset of the first non-whitespace byte, or n
+ */
+size_t scan_space(const char *s, size_t n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
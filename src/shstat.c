@@ -0,0 +1,48 @@
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include "shstat.h"
+
+static const char *const stat_names[STAT_NSTATS] = {
+    [STAT_READ] = "read",
+    [STAT_PARSE] = "parse",
+    [STAT_PARSE_HIT] = "parse_hit",
+    [STAT_BUILTIN] = "builtin",
+    [STAT_SPAWN] = "spawn",
+    [STAT_EXEC_FAIL] = "exec_fail",
+    [STAT_WAIT] = "wait",
+};
+
+void shstat_reset(struct shstat *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+uint64_t shstat_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void shstat_add(struct shstat *s, enum shstat_id id, uint64_t start) {
+    s->count[id]++;
+    s->ns[id] += shstat_now() - start;
+}
+
+void shstat_print(const struct shstat *s, uint64_t arena_bytes, struct sink *out) {
+    sink_printf(out, "%-10s %12s %16s %12s\n", "stage", "calls", "total ns", "ns/call");
+    for (int i = 0; i < STAT_NSTATS; i++) {
+        uint64_t n = s->count[i];
+        sink_printf(out, "%-10s %12" PRIu64 " %16" PRIu64 " %12" PRIu64 "\n",
+                    stat_names[i], n, s->ns[i], n ? s->ns[i] / n : 0);
+    }
+    sink_printf(out, "%-10s %12" PRIu64 " bytes\n", "arena", arena_bytes);
+}
+
+void shstat_json(const struct shstat *s, uint64_t arena_bytes, struct sink *out) {
+    sink_write(out, "{", 1);
+    for (int i = 0; i < STAT_NSTATS; i++) {
+        sink_printf(out, "\"%s\":{\"count\":%" PRIu64 ",\"ns\":%" PRIu64 "},",
+                    stat_names[i], s->count[i], s->ns[i]);
+    }
+    sink_printf(out, "\"arena_bytes\":%" PRIu64 "}\n", arena_bytes);
+}
@@ -0,0 +1,80 @@
+#ifndef SHSTAT_H
+#define SHSTAT_H
+
+#include <stdint.h>
+#include "sink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Environment variable naming a file to write the counters to as JSON
+ * when the shell exits */
+#define SHSTAT_ENV "MY_SHSTAT"
+
+/* Stages of the read-parse-execute loop that are timed */
+enum shstat_id {
+    STAT_READ,          // Waiting for a line (readline or script input)
+    STAT_PARSE,         // parse_line, for lines not in the parse cache
+    STAT_PARSE_HIT,     // Lines found in the parse cache
+    STAT_BUILTIN,       // Builtin dispatch and execution
+    STAT_SPAWN,         // Starting a child with posix_spawn or fork
+    STAT_EXEC_FAIL,     // Children that could not be started
+    STAT_WAIT,          // wait4 for foreground jobs and reaping
+    STAT_NSTATS,
+};
+
+/* Call counts and cumulative time for each stage */
+struct shstat {
+    uint64_t count[STAT_NSTATS];
+    uint64_t ns[STAT_NSTATS];
+};
+
+/**
+ * @brief Zero every counter.
+ *
+ * @param s The counters
+ */
+void shstat_reset(struct shstat *s);
+
+/**
+ * @brief Read CLOCK_MONOTONIC, to pass to shstat_add when the stage ends.
+ *
+ * @return Nanoseconds since an arbitrary point
+ */
+uint64_t shstat_now(void);
+
+/**
+ * @brief Count one call of a stage that began at start.
+ *
+ * @param s The counters
+ * @param id The stage
+ * @param start Value of shstat_now when the stage began
+ */
+void shstat_add(struct shstat *s, enum shstat_id id, uint64_t start);
+
+/**
+ * @brief Print one line per stage with its calls, total and mean time,
+ * followed by the bytes handed out by the command arena.
+ *
+ * @param s The counters
+ * @param arena_bytes Total bytes the arena has allocated
+ * @param out Where to print
+ */
+void shstat_print(const struct shstat *s, uint64_t arena_bytes, struct sink *out);
+
+/**
+ * @brief Print the counters as a single JSON object.
+ *
+ * @param s The counters
+ * @param arena_bytes Total bytes the arena has allocated
+ * @param out Where to print
+ */
+void shstat_json(const struct shstat *s, uint64_t arena_bytes, struct sink *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
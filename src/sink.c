@@ -0,0 +1,113 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "sink.h"
+
+void sink_init(struct sink *s, int fd) {
+    s->fd = fd;
+    s->error = 0;
+    s->wait = NULL;
+    s->wait_ctx = NULL;
+    s->used = 0;
+    s->niov = 0;
+}
+
+void sink_set_wait(struct sink *s, sink_wait_fn wait, void *ctx) {
+    s->wait = wait;
+    s->wait_ctx = ctx;
+}
+
+// Adds a segment, merging it with the previous one when they are adjacent.
+// Callers that copy into buf make sure a slot is free before copying.
+static void add_iov(struct sink *s, const void *p, size_t n) {
+    if (s->niov > 0) {
+        struct iovec *last = &s->iov[s->niov - 1];
+        if ((const char *)last->iov_base + last->iov_len == (const char *)p) {
+            last->iov_len += n;
+            return;
+        }
+    }
+    if (s->niov == SINK_IOVMAX) sink_flush(s);
+    s->iov[s->niov].iov_base = (void *)p;
+    s->iov[s->niov].iov_len = n;
+    s->niov++;
+}
+
+void sink_write(struct sink *s, const void *p, size_t n) {
+    if (s->error || n == 0) return;
+    if (s->niov == SINK_IOVMAX) sink_flush(s);
+
+    if (n > SINK_BUFSIZE - s->used) {
+        sink_flush(s);
+        // Too big to buffer at all: send it straight from the caller
+        if (n > SINK_BUFSIZE) {
+            add_iov(s, p, n);
+            sink_flush(s);
+            return;
+        }
+    }
+    memcpy(s->buf + s->used, p, n);
+    add_iov(s, s->buf + s->used, n);
+    s->used += n;
+}
+
+void sink_write_ref(struct sink *s, const void *p, size_t n) {
+    if (s->error || n == 0) return;
+    add_iov(s, p, n);
+}
+
+void sink_printf(struct sink *s, const char *fmt, ...) {
+    if (s->error) return;
+    if (s->niov == SINK_IOVMAX) sink_flush(s);
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(s->buf + s->used, SINK_BUFSIZE - s->used, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+
+    // Did not fit: make room and format again
+    if ((size_t)n >= SINK_BUFSIZE - s->used) {
+        sink_flush(s);
+        va_start(ap, fmt);
+        n = vsnprintf(s->buf, SINK_BUFSIZE, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n >= SINK_BUFSIZE) n = SINK_BUFSIZE - 1;
+    }
+    add_iov(s, s->buf + s->used, (size_t)n);
+    s->used += (size_t)n;
+}
+
+int sink_flush(struct sink *s) {
+    struct iovec *iov = s->iov;
+    int niov = s->niov;
+
+    while (niov > 0 && !s->error) {
+        ssize_t w = writev(s->fd, iov, niov);
+        if (w < 0) {
+            int err = errno;
+            if (err == EINTR) continue;
+            if (err == EAGAIN && s->wait && s->wait(s->wait_ctx, s->fd)) continue;
+            s->error = err;
+            break;
+        }
+
+        // Skip the segments that were written completely
+        while (niov > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if (niov > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+
+    s->niov = 0;
+    s->used = 0;
+    return s->error ? -1 : 0;
+}
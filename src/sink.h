@@ -0,0 +1,96 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Bytes of formatted output buffered before a flush */
+#define SINK_BUFSIZE (64 * 1024)
+
+/* Segments gathered into a single writev */
+#define SINK_IOVMAX 64
+
+/* Called when a non-blocking descriptor is full: returns true once it can
+ * be written again, or false to give up on the output */
+typedef bool (*sink_wait_fn)(void *ctx, int fd);
+
+/* Batched output to a file descriptor, used by builtins so they can write
+ * into a pipe from the shell itself when they run as a pipeline stage */
+struct sink {
+    int fd;
+    int error;      // errno of the first failed write, 0 if none
+    sink_wait_fn wait;  // NULL: a full non-blocking fd fails with EAGAIN
+    void *wait_ctx;
+    size_t used;    // bytes of buf in use
+    int niov;
+    struct iovec iov[SINK_IOVMAX];
+    char buf[SINK_BUFSIZE];
+};
+
+/**
+ * @brief Initialize a sink that writes to fd.
+ *
+ * @param s The sink
+ * @param fd The descriptor to write to
+ */
+void sink_init(struct sink *s, int fd);
+
+/**
+ * @brief Make a sink on a non-blocking descriptor wait for room instead of
+ * failing with EAGAIN.
+ *
+ * @param s The sink
+ * @param wait Called whenever the descriptor is full
+ * @param ctx Passed to wait
+ */
+void sink_set_wait(struct sink *s, sink_wait_fn wait, void *ctx);
+
+/**
+ * @brief Queue a copy of n bytes.
+ *
+ * @param s The sink
+ * @param p The data
+ * @param n Number of bytes
+ */
+void sink_write(struct sink *s, const void *p, size_t n);
+
+/**
+ * @brief Queue n bytes by reference, without copying. The memory must stay
+ * valid and unchanged until the next sink_flush.
+ *
+ * @param s The sink
+ * @param p The data
+ * @param n Number of bytes
+ */
+void sink_write_ref(struct sink *s, const void *p, size_t n);
+
+/**
+ * @brief Queue printf-style formatted output.
+ *
+ * @param s The sink
+ * @param fmt The format string
+ */
+void sink_printf(struct sink *s, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Write everything queued with as few writev calls as possible.
+ * After a write error (for example EPIPE when the reader has gone away) the
+ * sink discards further output.
+ *
+ * @param s The sink
+ * @return 0 on success, -1 if any write has failed
+ */
+int sink_flush(struct sink *s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
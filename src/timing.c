@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include "timing.h"
+
+static double tv_sec(struct timeval tv) {
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void tv_add(struct timeval *acc, struct timeval tv) {
+    acc->tv_sec += tv.tv_sec;
+    acc->tv_usec += tv.tv_usec;
+    if (acc->tv_usec >= 1000000) {
+        acc->tv_sec++;
+        acc->tv_usec -= 1000000;
+    }
+}
+
+void rusage_add(struct rusage *acc, const struct rusage *ru) {
+    tv_add(&acc->ru_utime, ru->ru_utime);
+    tv_add(&acc->ru_stime, ru->ru_stime);
+    if (ru->ru_maxrss > acc->ru_maxrss) acc->ru_maxrss = ru->ru_maxrss;
+    acc->ru_nvcsw += ru->ru_nvcsw;
+    acc->ru_nivcsw += ru->ru_nivcsw;
+}
+
+void timer_start(struct cmd_timer *t) {
+    getrusage(RUSAGE_SELF, &t->self);
+    clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+void timer_stop(const struct cmd_timer *t, const struct rusage *children,
+                struct cmd_times *out) {
+    struct timespec now;
+    struct rusage self;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+
+    out->real = (double)(now.tv_sec - t->start.tv_sec)
+        + (double)(now.tv_nsec - t->start.tv_nsec) / 1e9;
+
+    // The shell's share covers builtins and the cost of launching
+    out->user = tv_sec(self.ru_utime) - tv_sec(t->self.ru_utime)
+        + tv_sec(children->ru_utime);
+    out->sys = tv_sec(self.ru_stime) - tv_sec(t->self.ru_stime)
+        + tv_sec(children->ru_stime);
+    out->nvcsw = self.ru_nvcsw - t->self.ru_nvcsw + children->ru_nvcsw;
+    out->nivcsw = self.ru_nivcsw - t->self.ru_nivcsw + children->ru_nivcsw;
+
+    // The shell's peak is a lifetime high-water mark, so it only stands in
+    // when no child ran
+    out->maxrss = children->ru_maxrss ? children->ru_maxrss : self.ru_maxrss;
+}
+
+static void print_secs(struct sink *out, const char *label, double secs) {
+    if (secs < 0) secs = 0;
+    long min = (long)(secs / 60);
+    sink_printf(out, "%s\t%ldm%.3fs\n", label, min, secs - (double)min * 60);
+}
+
+void times_print(const struct cmd_times *t, struct sink *out) {
+    sink_write(out, "\n", 1);
+    print_secs(out, "real", t->real);
+    print_secs(out, "user", t->user);
+    print_secs(out, "sys", t->sys);
+    sink_printf(out, "maxrss\t%ldKB\n", t->maxrss);
+    sink_printf(out, "ctxsw\t%ld voluntary, %ld involuntary\n", t->nvcsw, t->nivcsw);
+}
+
+long time_threshold_ms(void) {
+    const char *s = getenv(TIME_THRESHOLD_ENV);
+    if (!s || !*s) return -1;
+    char *end;
+    long ms = strtol(s, &end, 10);
+    return *end || ms < 0 ? -1 : ms;
+}
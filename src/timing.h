@@ -0,0 +1,78 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <time.h>
+#include <sys/resource.h>
+#include "sink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Environment variable holding the auto-report threshold in milliseconds */
+#define TIME_THRESHOLD_ENV "MY_TIMETHRESHOLD"
+
+/* Snapshot taken when a timed command starts */
+struct cmd_timer {
+    struct timespec start;
+    struct rusage self;     // The shell's own usage, for in-process builtins
+};
+
+/* What a finished command cost */
+struct cmd_times {
+    double real;            // Seconds of wall-clock time
+    double user;            // Seconds of user CPU, shell and children
+    double sys;             // Seconds of system CPU, shell and children
+    long maxrss;            // Peak resident set size in KB
+    long nvcsw;             // Voluntary context switches
+    long nivcsw;            // Involuntary context switches
+};
+
+/**
+ * @brief Add the usage of one reaped child, as returned by wait4, to a
+ * running total. Times and counters are summed; maxrss keeps the largest.
+ *
+ * @param acc The total
+ * @param ru The child's usage
+ */
+void rusage_add(struct rusage *acc, const struct rusage *ru);
+
+/**
+ * @brief Record the start of a command.
+ *
+ * @param t The timer
+ */
+void timer_start(struct cmd_timer *t);
+
+/**
+ * @brief Compute what a command cost since timer_start.
+ *
+ * @param t The timer
+ * @param children Usage of the command's processes, summed with rusage_add
+ * @param out Receives the result
+ */
+void timer_stop(const struct cmd_timer *t, const struct rusage *children,
+                struct cmd_times *out);
+
+/**
+ * @brief Print the times in the style of bash's time keyword, followed by
+ * the peak RSS and context switch counts.
+ *
+ * @param t The times
+ * @param out Where to print
+ */
+void times_print(const struct cmd_times *t, struct sink *out);
+
+/**
+ * @brief Read the auto-report threshold from MY_TIMETHRESHOLD.
+ *
+ * @return The threshold in milliseconds, or -1 when unset or invalid
+ */
+long time_threshold_ms(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -1,6 +1,16 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "harness/unity.h"
 #include "../src/lab.h"
+#include "../src/heredoc.h"
+#include "../src/lexer.h"
+#include "../src/parse.h"
+#include "../src/proc.h"
+#include "../src/scan.h"
 
 void setUp(void) {
     setenv("MY_PROMPT", "foo>", 1);
@@ -235,6 +245,1048 @@ void test_ch_dir_empty(void)
 }
 
 
+// Runs of spaces between tokens should not produce empty arguments
+void test_cmd_parse_extra_spaces(void)
+{
+    char **rval = cmd_parse("  ls   -l  ");
+    TEST_ASSERT_EQUAL_STRING("ls", rval[0]);
+    TEST_ASSERT_EQUAL_STRING("-l", rval[1]);
+    TEST_ASSERT_NULL(rval[2]);
+    cmd_free(rval);
+}
+
+// Allocations are aligned and reset hands the same memory back out
+void test_arena_reset_reuses_memory(void)
+{
+    struct arena a;
+    arena_init(&a, 256);
+    char *first = arena_strdup(&a, "hello");
+    void *second = arena_alloc(&a, 3);
+    TEST_ASSERT_EQUAL_STRING("hello", first);
+    TEST_ASSERT_EQUAL_INT(0, (size_t)second % _Alignof(max_align_t));
+    arena_reset(&a);
+    TEST_ASSERT_EQUAL_PTR(first, arena_alloc(&a, 8));
+    arena_destroy(&a);
+}
+
+// Requests larger than a chunk get a dedicated chunk
+void test_arena_large_alloc(void)
+{
+    struct arena a;
+    arena_init(&a, 64);
+    char *big = arena_alloc(&a, 1000);
+    TEST_ASSERT_NOT_NULL(big);
+    memset(big, 'x', 1000);
+    char *small = arena_strdup(&a, "ok");
+    TEST_ASSERT_EQUAL_STRING("ok", small);
+    arena_destroy(&a);
+}
+
+// Commands are resolved through PATH once and then served from the cache
+void test_cmd_hash_lookup(void)
+{
+    struct cmd_hash h;
+    cmd_hash_init(&h);
+    const char *path = cmd_hash_lookup(&h, "sh");
+    TEST_ASSERT_NOT_NULL(path);
+    TEST_ASSERT_EQUAL_CHAR('/', path[0]);
+    TEST_ASSERT_EQUAL_PTR(path, cmd_hash_lookup(&h, "sh"));
+    TEST_ASSERT_NULL(cmd_hash_lookup(&h, "no-such-command-here"));
+    TEST_ASSERT_EQUAL_STRING("./x", cmd_hash_lookup(&h, "./x"));
+    cmd_hash_clear(&h);
+    TEST_ASSERT_EQUAL_INT(0, h.count);
+    cmd_hash_destroy(&h);
+}
+
+// Changing PATH throws away everything resolved against the old value
+void test_cmd_hash_path_change(void)
+{
+    char *saved = strdup(getenv("PATH"));
+    struct cmd_hash h;
+    cmd_hash_init(&h);
+    TEST_ASSERT_NOT_NULL(cmd_hash_lookup(&h, "sh"));
+    setenv("PATH", "/nonexistent-dir", 1);
+    TEST_ASSERT_NULL(cmd_hash_lookup(&h, "sh"));
+    setenv("PATH", saved, 1);
+    TEST_ASSERT_NOT_NULL(cmd_hash_lookup(&h, "sh"));
+    cmd_hash_destroy(&h);
+    free(saved);
+}
+
+// Parses a line that must be a single pipeline
+static struct pipeline *parse_one(struct arena *a, const char *line)
+{
+    struct node *n = parse_line(a, line, strlen(line), NULL);
+    if (!n) return NULL;
+    TEST_ASSERT_EQUAL_INT(NODE_PIPELINE, n->kind);
+    return n->pl;
+}
+
+// A line with "|" tokens becomes one stage per command
+void test_parse_line_pipeline(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    const char *line = "ls -l | grep 'a|b' | wc";
+    struct pipeline *pl = parse_one(&a, line);
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_EQUAL_INT(3, pl->nstages);
+    TEST_ASSERT_EQUAL_STRING("ls", pl->stages[0].argv[0]);
+    TEST_ASSERT_EQUAL_STRING("-l", pl->stages[0].argv[1]);
+    TEST_ASSERT_NULL(pl->stages[0].argv[2]);
+    TEST_ASSERT_EQUAL_STRING("grep", pl->stages[1].argv[0]);
+    TEST_ASSERT_EQUAL_STRING("a|b", pl->stages[1].argv[1]);
+    TEST_ASSERT_EQUAL_STRING("wc", pl->stages[2].argv[0]);
+    TEST_ASSERT_NULL(pl->stages[2].argv[1]);
+    arena_destroy(&a);
+}
+
+// Empty pipeline stages are rejected
+void test_parse_line_pipeline_empty_stage(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    TEST_ASSERT_NULL(parse_one(&a, "ls |"));
+    TEST_ASSERT_NULL(parse_one(&a, "| ls"));
+    TEST_ASSERT_NULL(parse_one(&a, "ls | | wc"));
+    arena_destroy(&a);
+}
+
+// Operators are recognized with or without surrounding blanks
+void test_lexer_operators(void)
+{
+    const char *line = "a|b>>c 2>&1 <d;e&<<<f\n";
+    enum tok_kind expected[] = {
+        TOK_WORD, TOK_PIPE, TOK_WORD, TOK_DGREAT, TOK_WORD, TOK_GREATAND,
+        TOK_WORD, TOK_LESS, TOK_WORD, TOK_SEMI, TOK_WORD, TOK_AMP,
+        TOK_TLESS, TOK_WORD, TOK_NEWLINE, TOK_EOF
+    };
+    struct lexer lx;
+    struct token tok;
+    lexer_init(&lx, line, strlen(line));
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], lexer_next(&lx, &tok));
+        if (tok.kind == TOK_GREATAND) {
+            TEST_ASSERT_EQUAL_INT(2, tok.io_number);
+        }
+    }
+}
+
+// Quotes and escapes group words and are removed from the text
+void test_cmd_parse_quotes(void)
+{
+    char **rval = cmd_parse("echo 'a  b' \"c \\\"d\\\"\" e\\ f\tg # comment");
+    TEST_ASSERT_EQUAL_STRING("echo", rval[0]);
+    TEST_ASSERT_EQUAL_STRING("a  b", rval[1]);
+    TEST_ASSERT_EQUAL_STRING("c \"d\"", rval[2]);
+    TEST_ASSERT_EQUAL_STRING("e f", rval[3]);
+    TEST_ASSERT_EQUAL_STRING("g", rval[4]);
+    TEST_ASSERT_NULL(rval[5]);
+    cmd_free(rval);
+    TEST_ASSERT_NULL(cmd_parse("echo 'open"));
+}
+
+// Copied, referenced and formatted output arrive in order after a flush
+void test_sink_writes_in_order(void)
+{
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    struct sink *out = malloc(sizeof(*out));
+    sink_init(out, pfd[1]);
+    sink_write(out, "a", 1);
+    sink_write_ref(out, "bc", 2);
+    sink_printf(out, "%d", 42);
+    TEST_ASSERT_EQUAL_INT(0, sink_flush(out));
+    char buf[16] = {0};
+    TEST_ASSERT_EQUAL_INT(5, read(pfd[0], buf, sizeof(buf) - 1));
+    TEST_ASSERT_EQUAL_STRING("abc42", buf);
+    close(pfd[0]);
+    close(pfd[1]);
+    free(out);
+}
+
+// Drains the pipe whose read end is *ctx, standing in for a reader
+static bool drain_pipe(void *ctx, int fd)
+{
+    (void)fd;
+    char buf[4096];
+    while (read(*(int *)ctx, buf, sizeof(buf)) > 0) {}
+    return true;
+}
+
+// Refuses to wait, as for a reader that has stopped
+static bool give_up(void *ctx, int fd)
+{
+    (void)ctx;
+    (void)fd;
+    return false;
+}
+
+// A full non-blocking pipe waits through the hook, or fails without one
+void test_sink_waits_when_full(void)
+{
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    fcntl(pfd[0], F_SETFL, O_NONBLOCK);
+    fcntl(pfd[1], F_SETFL, O_NONBLOCK);
+    // Several times what a default pipe holds
+    size_t n = 1024 * 1024;
+    char *data = malloc(n);
+    memset(data, 'x', n);
+    struct sink *out = malloc(sizeof(*out));
+
+    sink_init(out, pfd[1]);
+    sink_set_wait(out, drain_pipe, &pfd[0]);
+    sink_write_ref(out, data, n);
+    TEST_ASSERT_EQUAL_INT(0, sink_flush(out));
+
+    sink_init(out, pfd[1]);
+    sink_write_ref(out, data, n);
+    TEST_ASSERT_EQUAL_INT(-1, sink_flush(out));
+    TEST_ASSERT_EQUAL_INT(EAGAIN, out->error);
+
+    drain_pipe(&pfd[0], pfd[1]);
+    sink_init(out, pfd[1]);
+    sink_set_wait(out, give_up, NULL);
+    sink_write_ref(out, data, n);
+    TEST_ASSERT_EQUAL_INT(-1, sink_flush(out));
+    TEST_ASSERT_EQUAL_INT(EAGAIN, out->error);
+
+    close(pfd[0]);
+    close(pfd[1]);
+    free(out);
+    free(data);
+}
+
+// Every classifier the CPU supports agrees with the scalar one, whatever
+// the position of the first interesting byte and the length of the input
+void test_scan_impls_match_scalar(void)
+{
+    static const char fill[] = "a \t";
+    static const char probe[] = "ab \t\n|&;<>'\"\\\v\f\r#\x7f\x80\xff";
+    char buf[100];
+
+    for (size_t f = 0; f < sizeof(fill) - 1; f++) {
+        for (size_t n = 0; n < sizeof(buf); n++) {
+            for (size_t pos = 0; pos <= n; pos++) {
+                memset(buf, fill[f], sizeof(buf));
+                if (pos < n) buf[pos] = probe[(n + pos) % (sizeof(probe) - 1)];
+
+                scan_set_impl(SCAN_SCALAR);
+                size_t plain = scan_plain(buf, n);
+                size_t blank = scan_blank(buf, n);
+                size_t space = scan_space(buf, n);
+                for (int impl = SCAN_SSE2; impl <= SCAN_AVX2; impl++) {
+                    if (scan_set_impl((enum scan_impl)impl) != 0) continue;
+                    TEST_ASSERT_EQUAL_UINT(plain, scan_plain(buf, n));
+                    TEST_ASSERT_EQUAL_UINT(blank, scan_blank(buf, n));
+                    TEST_ASSERT_EQUAL_UINT(space, scan_space(buf, n));
+                }
+            }
+        }
+    }
+    scan_set_impl(scan_best_impl());
+}
+
+// The scalar classifier matches isspace in the C locale
+void test_scan_space_matches_isspace(void)
+{
+    scan_set_impl(SCAN_SCALAR);
+    for (int c = 1; c < 256; c++) {
+        char b = (char)c;
+        TEST_ASSERT_EQUAL_INT(isspace(c) ? 1 : 0, scan_space(&b, 1));
+    }
+    scan_set_impl(scan_best_impl());
+}
+
+// Job numbers, specs and the current/previous marks follow bash
+void test_jobs_table(void)
+{
+    struct job_table jt;
+    jobs_init(&jt);
+    struct job_proc procs[2] = { { .pid = 100 }, { .pid = 101 } };
+    struct job tmpl = { .pgid = 100, .state = JOB_RUNNING,
+                        .nprocs = 2, .procs = procs, .cmd = "a | b" };
+
+    struct job *one = jobs_add(&jt, &tmpl);
+    struct job *two = jobs_add(&jt, &tmpl);
+    TEST_ASSERT_EQUAL_INT(1, one->id);
+    TEST_ASSERT_EQUAL_INT(2, two->id);
+    TEST_ASSERT_EQUAL_PTR(two, jobs_find(&jt, NULL));
+    TEST_ASSERT_EQUAL_PTR(one, jobs_find(&jt, "%-"));
+    TEST_ASSERT_EQUAL_PTR(one, jobs_find(&jt, "%1"));
+    TEST_ASSERT_NULL(jobs_find(&jt, "%3"));
+    TEST_ASSERT_NULL(jobs_find(&jt, "x"));
+
+    jobs_remove(&jt, two);
+    TEST_ASSERT_EQUAL_PTR(one, jobs_find(&jt, "%%"));
+    TEST_ASSERT_EQUAL_INT(2, jobs_add(&jt, &tmpl)->id);
+    TEST_ASSERT_EQUAL_INT(2, jobs_count(&jt));
+
+    // Free the table without signalling the made-up process groups
+    for (size_t i = 0; i < jt.nslots; i++) {
+        if (jt.slots[i]) jobs_remove(&jt, jt.slots[i]);
+    }
+    jobs_destroy(&jt);
+}
+
+// A job is done when every process is, stopped when any process is
+void test_job_update_state(void)
+{
+    struct job_proc procs[2] = { { .pid = 100 }, { .pid = 101 } };
+    struct job j = { .pgid = 100, .state = JOB_RUNNING, .nprocs = 2, .procs = procs };
+
+    TEST_ASSERT_FALSE(job_update(&j, 999, 0));
+    TEST_ASSERT_TRUE(job_update(&j, 101, 0x137f));  // stopped by SIGSTOP
+    TEST_ASSERT_EQUAL_INT(JOB_STOPPED, j.state);
+    TEST_ASSERT_TRUE(job_update(&j, 101, 3 << 8));  // exited with 3
+    TEST_ASSERT_EQUAL_INT(JOB_RUNNING, j.state);
+    TEST_ASSERT_TRUE(job_update(&j, 100, 0));
+    TEST_ASSERT_EQUAL_INT(JOB_DONE, j.state);
+    TEST_ASSERT_EQUAL_INT(3, job_status(&j));
+}
+
+// A trailing '&' marks the pipeline as a background job
+void test_parse_line_pipeline_background(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    const char *line = "sleep 5 | cat &";
+    struct pipeline *pl = parse_one(&a, line);
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_TRUE(pl->background);
+    TEST_ASSERT_EQUAL_INT(2, pl->nstages);
+    TEST_ASSERT_EQUAL_INT(13, pl->textlen);
+    TEST_ASSERT_EQUAL_INT(0, strncmp("sleep 5 | cat", pl->text, pl->textlen));
+    TEST_ASSERT_NULL(parse_one(&a, "&"));
+    arena_destroy(&a);
+}
+
+// Escapes expand and the text is reused until an input it shows changes
+void test_prompt_render_cache(void)
+{
+    struct prompt p;
+    prompt_init(&p);
+    struct prompt_inputs in = { .cwd_gen = 0, .status = 0, .njobs = 2 };
+
+    const char *text = prompt_render(&p, "[\\?:\\j] \\\\ ", &in);
+    TEST_ASSERT_EQUAL_STRING("[0:2] \\ ", text);
+    TEST_ASSERT_EQUAL_INT(1, p.renders);
+
+    // The template ignores the cwd, so a cd does not cost a render
+    in.cwd_gen++;
+    prompt_render(&p, "[\\?:\\j] \\\\ ", &in);
+    TEST_ASSERT_EQUAL_INT(1, p.renders);
+
+    in.status = 127;
+    TEST_ASSERT_EQUAL_STRING("[127:2] \\ ", prompt_render(&p, "[\\?:\\j] \\\\ ", &in));
+    TEST_ASSERT_EQUAL_INT(2, p.renders);
+
+    TEST_ASSERT_EQUAL_STRING("foo>", prompt_render(&p, "foo>", &in));
+    TEST_ASSERT_EQUAL_INT(3, p.renders);
+    prompt_destroy(&p);
+}
+
+// \w shows the working directory with $HOME abbreviated to ~
+void test_prompt_render_cwd(void)
+{
+    struct prompt p;
+    prompt_init(&p);
+    struct prompt_inputs in = { 0 };
+    char *home = getenv("HOME");
+    char *saved = getcwd(NULL, 0);
+
+    TEST_ASSERT_EQUAL_INT(0, chdir("/"));
+    TEST_ASSERT_EQUAL_STRING("/ /", prompt_render(&p, "\\w \\W", &in));
+    TEST_ASSERT_EQUAL_INT(0, chdir(home));
+    in.cwd_gen++;
+    TEST_ASSERT_EQUAL_STRING("~ ~", prompt_render(&p, "\\w \\W", &in));
+
+    TEST_ASSERT_EQUAL_INT(0, chdir(saved));
+    free(saved);
+    prompt_destroy(&p);
+}
+
+
+// -c input is split on newlines and the last line needs no terminator
+void test_input_string_lines(void)
+{
+    struct input in;
+    size_t len;
+    TEST_ASSERT_EQUAL_INT(0, input_init_string(&in, "echo a\n\nls -l"));
+    TEST_ASSERT_EQUAL_STRING("echo a", input_next(&in, NULL, &len));
+    TEST_ASSERT_EQUAL_INT(6, len);
+    TEST_ASSERT_EQUAL_STRING("", input_next(&in, NULL, &len));
+    TEST_ASSERT_EQUAL_STRING("ls -l", input_next(&in, NULL, &len));
+    TEST_ASSERT_EQUAL_INT(5, len);
+    TEST_ASSERT_NULL(input_next(&in, NULL, &len));
+    TEST_ASSERT_EQUAL_UINT(3, in.lineno);
+    input_destroy(&in);
+}
+
+// Lines read from a pipe come back whole even when they span reads
+void test_input_fd_lines(void)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+    const char *text = "first\nsecond line\nthird";
+    TEST_ASSERT_EQUAL_INT((int)strlen(text), write(fds[1], text, strlen(text)));
+    close(fds[1]);
+
+    struct input in;
+    size_t len;
+    input_init_fd(&in, fds[0], false);
+    TEST_ASSERT_EQUAL_STRING("first", input_next(&in, NULL, &len));
+    TEST_ASSERT_EQUAL_STRING("second line", input_next(&in, NULL, &len));
+    TEST_ASSERT_EQUAL_STRING("third", input_next(&in, NULL, &len));
+    TEST_ASSERT_NULL(input_next(&in, NULL, &len));
+    input_destroy(&in);
+}
+
+// A command started between lines of the shell's stdin reads the next
+// line, whether stdin is a pipe or a seekable file
+void test_input_shared_fd(void)
+{
+    const char *text = "head -1\nfoo\necho bar\n";
+    struct cmd_hash h;
+    cmd_hash_init(&h);
+    const char *head = cmd_hash_lookup(&h, "head");
+    TEST_ASSERT_NOT_NULL(head);
+
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    TEST_ASSERT_EQUAL_INT((int)strlen(text), write(pfd[1], text, strlen(text)));
+    close(pfd[1]);
+    char path[] = "/tmp/test-lab-XXXXXX";
+    int file = mkstemp(path);
+    TEST_ASSERT_TRUE(file >= 0);
+    TEST_ASSERT_EQUAL_INT((int)strlen(text), write(file, text, strlen(text)));
+    lseek(file, 0, SEEK_SET);
+    unlink(path);
+
+    int fds[] = { pfd[0], file };
+    for (size_t i = 0; i < 2; i++) {
+        struct input in;
+        size_t len;
+        input_init_fd(&in, fds[i], true);
+        TEST_ASSERT_EQUAL_STRING("head -1", input_next(&in, NULL, &len));
+        input_sync(&in);
+        if (fds[i] == file)
+            TEST_ASSERT_EQUAL_INT(8, lseek(file, 0, SEEK_CUR));
+
+        int out[2];
+        TEST_ASSERT_EQUAL_INT(0, pipe(out));
+        char *argv[] = { "head", "-1", NULL };
+        pid_t pid = spawn_cmd(head, argv, 0, -1, fds[i], out[1], NULL);
+        close(out[1]);
+        TEST_ASSERT_TRUE(pid > 0);
+        char buf[16] = {0};
+        ssize_t n = read(out[0], buf, sizeof(buf) - 1);
+        close(out[0]);
+        waitpid(pid, NULL, 0);
+        TEST_ASSERT_EQUAL_INT(4, n);
+        TEST_ASSERT_EQUAL_STRING("foo\n", buf);
+        input_destroy(&in);
+    }
+    cmd_hash_destroy(&h);
+}
+
+// A regular script is mapped and its lines come back unterminated
+void test_input_file_mapped(void)
+{
+    char path[] = "/tmp/test-lab-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    const char *text = "echo a\n  ls  \nexit";
+    TEST_ASSERT_EQUAL_INT((int)strlen(text), write(fd, text, strlen(text)));
+    close(fd);
+
+    struct input in;
+    size_t len;
+    TEST_ASSERT_EQUAL_INT(0, input_init_file(&in, path));
+    TEST_ASSERT_EQUAL_INT(INPUT_MMAP, in.kind);
+    const char *line = input_next(&in, NULL, &len);
+    TEST_ASSERT_EQUAL_INT(6, len);
+    TEST_ASSERT_EQUAL_INT(0, strncmp("echo a", line, len));
+    TEST_ASSERT_EQUAL_CHAR('\n', line[len]);
+
+    line = trim_white_n(input_next(&in, NULL, &len), &len);
+    TEST_ASSERT_EQUAL_INT(2, len);
+    TEST_ASSERT_EQUAL_INT(0, strncmp("ls", line, len));
+
+    line = input_next(&in, NULL, &len);
+    TEST_ASSERT_EQUAL_INT(4, len);
+    TEST_ASSERT_EQUAL_INT(0, strncmp("exit", line, len));
+    TEST_ASSERT_NULL(input_next(&in, NULL, &len));
+    input_destroy(&in);
+    unlink(path);
+
+    TEST_ASSERT_EQUAL_INT(-1, input_init_file(&in, path));
+}
+
+// A leading unquoted 'time' marks the pipeline instead of being a command
+void test_parse_line_pipeline_time(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    struct pipeline *pl = parse_one(&a, "time ls | wc");
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_TRUE(pl->timed);
+    TEST_ASSERT_EQUAL_INT(2, pl->nstages);
+    TEST_ASSERT_EQUAL_STRING("ls", pl->stages[0].argv[0]);
+    TEST_ASSERT_EQUAL_INT(7, pl->textlen);
+
+    pl = parse_one(&a, "time");
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_TRUE(pl->timed);
+    TEST_ASSERT_EQUAL_INT(0, pl->nstages);
+
+    pl = parse_one(&a, "'time' x");
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_FALSE(pl->timed);
+    TEST_ASSERT_EQUAL_STRING("time", pl->stages[0].argv[0]);
+    arena_destroy(&a);
+}
+
+// Child usage adds up, keeps the largest RSS and prints like bash
+void test_rusage_add_and_print(void)
+{
+    struct rusage acc = {0};
+    struct rusage ru = { .ru_utime = { 0, 600000 }, .ru_maxrss = 100, .ru_nvcsw = 2 };
+    rusage_add(&acc, &ru);
+    ru.ru_maxrss = 50;
+    rusage_add(&acc, &ru);
+    TEST_ASSERT_EQUAL_INT(1, acc.ru_utime.tv_sec);
+    TEST_ASSERT_EQUAL_INT(200000, acc.ru_utime.tv_usec);
+    TEST_ASSERT_EQUAL_INT(100, acc.ru_maxrss);
+    TEST_ASSERT_EQUAL_INT(4, acc.ru_nvcsw);
+
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    struct sink *out = malloc(sizeof(*out));
+    sink_init(out, pfd[1]);
+    struct cmd_times t = { .real = 61.5, .user = 0.25, .maxrss = 100, .nvcsw = 4 };
+    times_print(&t, out);
+    TEST_ASSERT_EQUAL_INT(0, sink_flush(out));
+    char buf[256] = {0};
+    TEST_ASSERT_TRUE(read(pfd[0], buf, sizeof(buf) - 1) > 0);
+    TEST_ASSERT_EQUAL_STRING("\nreal\t1m1.500s\nuser\t0m0.250s\nsys\t0m0.000s\n"
+                             "maxrss\t100KB\nctxsw\t4 voluntary, 0 involuntary\n", buf);
+    close(pfd[0]);
+    close(pfd[1]);
+    free(out);
+}
+
+// A timed group reports what the commands inside it cost
+void test_time_group(void)
+{
+    struct shell sh = {0};
+    sh.command = "";
+    sh_init(&sh);
+    const char *line = "time { sh -c 'i=0; while [ $i -lt 200000 ]; do i=$((i+1)); done'; }";
+    struct node *n = parse_line(&sh.arena, line, strlen(line), NULL);
+    TEST_ASSERT_NOT_NULL(n);
+
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    int saved = dup(STDERR_FILENO);
+    dup2(pfd[1], STDERR_FILENO);
+    close(pfd[1]);
+    TEST_ASSERT_EQUAL_INT(0, exec_node(&sh, n));
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    char buf[256] = {0};
+    TEST_ASSERT_TRUE(read(pfd[0], buf, sizeof(buf) - 1) > 0);
+    close(pfd[0]);
+    long min;
+    double user, sys;
+    const char *p = strstr(buf, "user\t");
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_EQUAL_INT(2, sscanf(p, "user\t%ldm%lfs", &min, &user));
+    p = strstr(buf, "sys\t");
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_EQUAL_INT(2, sscanf(p, "sys\t%ldm%lfs", &min, &sys));
+    TEST_ASSERT_TRUE(user + sys > 0.01);
+    sh_destroy(&sh);
+}
+
+// Counters accumulate per stage and serialize as one JSON object
+void test_shstat_json(void)
+{
+    struct shstat st;
+    shstat_reset(&st);
+    shstat_add(&st, STAT_PARSE, shstat_now());
+    shstat_add(&st, STAT_PARSE, shstat_now());
+    TEST_ASSERT_EQUAL_UINT64(2, st.count[STAT_PARSE]);
+    TEST_ASSERT_EQUAL_UINT64(0, st.count[STAT_SPAWN]);
+    st.ns[STAT_PARSE] = 30;
+
+    int pfd[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(pfd));
+    struct sink *out = malloc(sizeof(*out));
+    sink_init(out, pfd[1]);
+    shstat_json(&st, 64, out);
+    TEST_ASSERT_EQUAL_INT(0, sink_flush(out));
+    char buf[512] = {0};
+    TEST_ASSERT_TRUE(read(pfd[0], buf, sizeof(buf) - 1) > 0);
+    TEST_ASSERT_EQUAL_CHAR('{', buf[0]);
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"parse\":{\"count\":2,\"ns\":30}"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "\"arena_bytes\":64}\n"));
+    close(pfd[0]);
+    close(pfd[1]);
+    free(out);
+}
+
+// Every builtin is found by its own name and nothing else matches
+void test_builtin_find(void)
+{
+    static const char *const names[] = {
+        "bg", "cd", "exit", "fg", "hash", "history", "jobs", "shstat",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const struct builtin *b = builtin_find(names[i]);
+        TEST_ASSERT_NOT_NULL(b);
+        TEST_ASSERT_EQUAL_STRING(names[i], b->name);
+    }
+    static const char *const others[] = { "", "b", "cdx", "ex", "h", "hi", "ls", "shstats" };
+    for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+        TEST_ASSERT_NULL(builtin_find(others[i]));
+    }
+    TEST_ASSERT_NULL(builtin_find(NULL));
+    TEST_ASSERT_TRUE(builtin_in_pipeline("jobs"));
+    TEST_ASSERT_FALSE(builtin_in_pipeline("cd"));
+    TEST_ASSERT_FALSE(builtin_in_pipeline("ls"));
+}
+
+static void keep_last_line(void *ctx, const char *line)
+{
+    char *last = ctx;
+    strcpy(last, line);
+}
+
+// Appends land at the end, loads read only the tail, trims keep the tail
+void test_histfile_append_load_trim(void)
+{
+    char path[] = "/tmp/test-lab-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    struct histfile hf;
+    TEST_ASSERT_EQUAL_INT(0, histfile_open(&hf, path));
+    TEST_ASSERT_EQUAL_INT(0, histfile_append(&hf, "one", 3));
+    TEST_ASSERT_EQUAL_INT(0, histfile_append(&hf, "two", 3));
+    TEST_ASSERT_EQUAL_INT(0, histfile_append(&hf, "three", 5));
+
+    char last[16] = "";
+    TEST_ASSERT_EQUAL_INT(2, histfile_load(&hf, 2, keep_last_line, last));
+    TEST_ASSERT_EQUAL_STRING("three", last);
+    TEST_ASSERT_EQUAL_INT(3, histfile_load(&hf, 10, keep_last_line, last));
+
+    TEST_ASSERT_EQUAL_INT(0, histfile_trim(path, 1));
+    TEST_ASSERT_EQUAL_INT(0, histfile_append(&hf, "four", 4));
+    char buf[32] = {0};
+    fd = open(path, O_RDONLY);
+    TEST_ASSERT_EQUAL_INT(11, read(fd, buf, sizeof(buf) - 1));
+    TEST_ASSERT_EQUAL_STRING("three\nfour\n", buf);
+    close(fd);
+
+    histfile_close(&hf);
+    unlink(path);
+}
+
+// Trigram and short-pattern searches return matches newest first and can
+// continue from the last match
+void test_histindex_search(void)
+{
+    struct histindex ix;
+    histindex_init(&ix, 0);
+    static const char *const lines[] = {
+        "git status", "make check", "git commit -m wip", "ls", "git status",
+    };
+    for (size_t i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, lines[i], strlen(lines[i])));
+    }
+    // The repeated "git status" is one string
+    TEST_ASSERT_EQUAL_INT(4, histindex_catch_up(&ix, 0));
+    TEST_ASSERT_EQUAL_INT(2, histindex_catch_up(&ix, 2));
+
+    size_t ids[8];
+    TEST_ASSERT_EQUAL_INT(3, histindex_search(&ix, "git", 3, ix.nentries, ids, 8));
+    TEST_ASSERT_EQUAL_INT(4, ids[0]);
+    TEST_ASSERT_EQUAL_INT(2, ids[1]);
+    TEST_ASSERT_EQUAL_INT(0, ids[2]);
+    TEST_ASSERT_EQUAL_INT(0, ix.nstrs - ix.indexed);
+
+    // Both trigrams of "abcd" are in one entry, but not next to each other
+    TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, "abc bcd", 7));
+    TEST_ASSERT_EQUAL_INT(0, histindex_search(&ix, "abcd", 4, ix.nentries, ids, 8));
+    TEST_ASSERT_EQUAL_INT(1, histindex_search(&ix, "status", 6, 4, ids, 8));
+    TEST_ASSERT_EQUAL_INT(0, ids[0]);
+    TEST_ASSERT_EQUAL_INT(1, histindex_search(&ix, "ls", 2, ix.nentries, ids, 1));
+    TEST_ASSERT_EQUAL_INT(3, ids[0]);
+    TEST_ASSERT_EQUAL_INT(0, histindex_search(&ix, "zzz", 3, ix.nentries, ids, 8));
+    histindex_destroy(&ix);
+}
+
+// Repeated lines share one pooled string; ignoredups skips a repeat of the
+// previous entry and erasedups drops the earlier copies
+void test_histindex_histcontrol(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, histcontrol_parse(NULL));
+    TEST_ASSERT_EQUAL_INT(HISTCONTROL_IGNOREDUPS, histcontrol_parse("ignorespace:ignoredups"));
+    TEST_ASSERT_EQUAL_INT(HISTCONTROL_IGNOREDUPS | HISTCONTROL_ERASEDUPS,
+                          histcontrol_parse("ignoreboth:erasedups"));
+
+    struct histindex ix;
+    histindex_init(&ix, 0);
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, i % 2 ? "ls" : "make", i % 2 ? 2 : 4));
+    }
+    TEST_ASSERT_EQUAL_INT(1000, ix.nentries);
+    TEST_ASSERT_EQUAL_INT(2, ix.nstrs);
+    TEST_ASSERT_EQUAL_INT(8, ix.pool_len);
+    histindex_destroy(&ix);
+
+    histindex_init(&ix, HISTCONTROL_IGNOREDUPS);
+    TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, "ls", 2));
+    TEST_ASSERT_EQUAL_INT(0, histindex_add(&ix, "ls", 2));
+    TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, "pwd", 3));
+    TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, "ls", 2));
+    TEST_ASSERT_EQUAL_INT(3, ix.live);
+    histindex_destroy(&ix);
+
+    histindex_init(&ix, HISTCONTROL_ERASEDUPS);
+    static const char *const lines[] = { "ls", "pwd", "ls", "make", "ls" };
+    for (size_t i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL_INT(1, histindex_add(&ix, lines[i], strlen(lines[i])));
+    }
+    TEST_ASSERT_EQUAL_INT(3, ix.live);
+    TEST_ASSERT_NULL(histindex_text(&ix, 0, NULL));
+    TEST_ASSERT_NULL(histindex_text(&ix, 2, NULL));
+    size_t len;
+    TEST_ASSERT_EQUAL_STRING("pwd", histindex_text(&ix, 1, &len));
+    TEST_ASSERT_EQUAL_INT(3, len);
+    TEST_ASSERT_EQUAL_STRING("ls", histindex_text(&ix, 4, NULL));
+
+    // Erased entries never match
+    size_t ids[4];
+    TEST_ASSERT_EQUAL_INT(1, histindex_search(&ix, "ls", 2, ix.nentries, ids, 4));
+    TEST_ASSERT_EQUAL_INT(4, ids[0]);
+    histindex_destroy(&ix);
+}
+
+// Redirections are taken out of argv, in order, with their default
+// descriptors; a here-string gains its newline
+void test_parse_line_pipeline_redirs(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    const char *line = "sort <in -r 2>&1 >>'out file' | 3>&- wc <<< \"a b\"";
+    struct pipeline *pl = parse_one(&a, line);
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_EQUAL_INT(2, pl->nstages);
+    TEST_ASSERT_EQUAL_STRING("sort", pl->stages[0].argv[0]);
+    TEST_ASSERT_EQUAL_STRING("-r", pl->stages[0].argv[1]);
+    TEST_ASSERT_NULL(pl->stages[0].argv[2]);
+
+    const struct redir *r = pl->stages[0].redirs;
+    TEST_ASSERT_EQUAL_INT(3, pl->stages[0].nredirs);
+    TEST_ASSERT_EQUAL_INT(REDIR_IN, r[0].kind);
+    TEST_ASSERT_EQUAL_INT(0, r[0].fd);
+    TEST_ASSERT_EQUAL_STRING("in", r[0].word);
+    TEST_ASSERT_EQUAL_INT(REDIR_DUP, r[1].kind);
+    TEST_ASSERT_EQUAL_INT(2, r[1].fd);
+    TEST_ASSERT_EQUAL_INT(1, r[1].src);
+    TEST_ASSERT_EQUAL_INT(REDIR_APPEND, r[2].kind);
+    TEST_ASSERT_EQUAL_INT(1, r[2].fd);
+    TEST_ASSERT_EQUAL_STRING("out file", r[2].word);
+
+    r = pl->stages[1].redirs;
+    TEST_ASSERT_EQUAL_INT(2, pl->stages[1].nredirs);
+    TEST_ASSERT_EQUAL_INT(REDIR_CLOSE, r[0].kind);
+    TEST_ASSERT_EQUAL_INT(3, r[0].fd);
+    TEST_ASSERT_EQUAL_INT(REDIR_STRING, r[1].kind);
+    TEST_ASSERT_EQUAL_STRING("a b\n", r[1].word);
+    TEST_ASSERT_EQUAL_INT(4, r[1].len);
+
+    // Only redirections is a command; a missing or bad target is not
+    pl = parse_one(&a, "> f");
+    TEST_ASSERT_NOT_NULL(pl);
+    TEST_ASSERT_NULL(pl->stages[0].argv[0]);
+    TEST_ASSERT_NULL(parse_one(&a, "ls >"));
+    TEST_ASSERT_NULL(parse_one(&a, "ls > | wc"));
+    TEST_ASSERT_NULL(parse_one(&a, "ls >&x"));
+    arena_destroy(&a);
+}
+
+// A builtin's redirections are applied in the shell and undone afterwards
+void test_redir_save_restore(void)
+{
+    char path[] = "/tmp/test-redir-XXXXXX";
+    int tmp = mkstemp(path);
+    TEST_ASSERT_TRUE(tmp >= 0);
+    close(tmp);
+
+    struct arena a;
+    arena_init(&a, 0);
+    struct redir list[] = {
+        { .kind = REDIR_OUT, .fd = 7, .src = -1, .word = path, .len = strlen(path) },
+        { .kind = REDIR_STRING, .fd = 8, .src = -1, .word = "hi\n", .len = 3 },
+    };
+    struct redirs rs;
+    TEST_ASSERT_EQUAL_INT(0, redir_open(&rs, list, 2, &a));
+    TEST_ASSERT_TRUE(rs.fds[0] >= REDIR_FD_MIN);
+    TEST_ASSERT_TRUE(fcntl(rs.fds[0], F_GETFD) & FD_CLOEXEC);
+
+    int *saved = redir_save(&rs, &a);
+    TEST_ASSERT_NOT_NULL(saved);
+    TEST_ASSERT_EQUAL_INT(0, redir_apply(&rs));
+    char buf[8];
+    TEST_ASSERT_EQUAL_INT(3, read(8, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_INT(3, write(7, buf, 3));
+    redir_restore(&rs, saved);
+    redir_close(&rs);
+    TEST_ASSERT_EQUAL_INT(-1, fcntl(7, F_GETFD));
+    TEST_ASSERT_EQUAL_INT(-1, fcntl(8, F_GETFD));
+
+    FILE *f = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_NOT_NULL(fgets(buf, sizeof(buf), f));
+    TEST_ASSERT_EQUAL_STRING("hi\n", buf);
+    fclose(f);
+
+    // A failed open leaves nothing behind
+    list[0].word = "/nonexistent/dir/file";
+    TEST_ASSERT_EQUAL_INT(-1, redir_open(&rs, list, 2, &a));
+    unlink(path);
+    arena_destroy(&a);
+}
+
+// Bodies are read from the lines after the command, up to the delimiter;
+// small ones land in a pipe and large ones in a memfd
+void test_heredoc_read(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    struct input in;
+    TEST_ASSERT_EQUAL_INT(0, input_init_string(&in,
+        "cat <<EOF | wc <<-'E N D'\nhello\n\tworld\nEOF\n\tone\n\tE N D\nnext"));
+    size_t len;
+    char *line = input_next(&in, NULL, &len);
+    struct node *list = parse_line(&a, line, len, NULL);
+    TEST_ASSERT_NOT_NULL(list);
+    TEST_ASSERT_EQUAL_INT(2, list->nheredocs);
+    struct pipeline *pl = list->pl;
+    TEST_ASSERT_EQUAL_INT(2, pl->nheredocs);
+    TEST_ASSERT_EQUAL_INT(REDIR_HEREDOC, pl->stages[1].redirs[0].kind);
+    TEST_ASSERT_TRUE(pl->stages[1].redirs[0].strip_tabs);
+    TEST_ASSERT_EQUAL_STRING("E N D", pl->stages[1].redirs[0].word);
+
+    TEST_ASSERT_EQUAL_INT(0, heredoc_read(list, &in, NULL, &a));
+    TEST_ASSERT_EQUAL_INT(0, strncmp("cat <<EOF", pl->text, 9));
+    char buf[64];
+    ssize_t n = read(pl->stages[0].redirs[0].here_fd, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_INT(13, n);
+    TEST_ASSERT_EQUAL_INT(0, memcmp("hello\n\tworld\n", buf, 13));
+    n = read(pl->stages[1].redirs[0].here_fd, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_INT(4, n);
+    TEST_ASSERT_EQUAL_INT(0, memcmp("one\n", buf, 4));
+    heredoc_close(list);
+    TEST_ASSERT_EQUAL_INT(-1, pl->stages[0].redirs[0].here_fd);
+    TEST_ASSERT_EQUAL_STRING("next", input_next(&in, NULL, &len));
+    input_destroy(&in);
+
+    // A large body from a mapped script, delimited by end of file
+    char path[] = "/tmp/test-lab-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    static const char row[] = "0123456789abcdef0123456789abcdef\n";
+    TEST_ASSERT_EQUAL_INT(5, write(fd, "x<<Z\n", 5));
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL_INT(sizeof(row) - 1, write(fd, row, sizeof(row) - 1));
+    }
+    close(fd);
+    TEST_ASSERT_EQUAL_INT(0, input_init_file(&in, path));
+    line = input_next(&in, NULL, &len);
+    list = parse_line(&a, line, len, NULL);
+    TEST_ASSERT_NOT_NULL(list);
+    pl = list->pl;
+    TEST_ASSERT_EQUAL_INT(0, heredoc_read(list, &in, NULL, &a));
+    fd = pl->stages[0].redirs[0].here_fd;
+    struct stat st;
+    TEST_ASSERT_EQUAL_INT(0, fstat(fd, &st));
+    TEST_ASSERT_TRUE(S_ISREG(st.st_mode));
+    TEST_ASSERT_EQUAL_INT(1000 * (sizeof(row) - 1), st.st_size);
+    TEST_ASSERT_EQUAL_INT(sizeof(row) - 1, read(fd, buf, sizeof(row) - 1));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(row, buf, sizeof(row) - 1));
+    heredoc_close(list);
+    input_destroy(&in);
+    unlink(path);
+    arena_destroy(&a);
+}
+
+// && and || bind tighter than ; and &, and both group to the left
+void test_parse_line_lists(void)
+{
+    struct arena a;
+    arena_init(&a, 0);
+    const char *line = "a; b && c || d & e";
+    enum parse_status st;
+    struct node *n = parse_line(&a, line, strlen(line), &st);
+    TEST_ASSERT_NOT_NULL(n);
+    TEST_ASSERT_EQUAL_INT(PARSE_OK, st);
+    TEST_ASSERT_EQUAL_INT(NODE_SEQ, n->kind);
+    TEST_ASSERT_EQUAL_STRING("e", n->right->pl->stages[0].argv[0]);
+    TEST_ASSERT_EQUAL_INT(NODE_SEQ, n->left->kind);
+    TEST_ASSERT_EQUAL_STRING("a", n->left->left->pl->stages[0].argv[0]);
+
+    // The backgrounded and-or list becomes one ( ) job
+    struct pipeline *bg = n->left->right->pl;
+    TEST_ASSERT_TRUE(bg->background);
+    TEST_ASSERT_TRUE(bg->stages[0].subshell);
+    TEST_ASSERT_EQUAL_INT(0, strncmp("b && c || d", bg->text, bg->textlen));
+    struct node *or = bg->stages[0].body;
+    TEST_ASSERT_EQUAL_INT(NODE_OR, or->kind);
+    TEST_ASSERT_EQUAL_INT(NODE_AND, or->left->kind);
+    TEST_ASSERT_EQUAL_STRING("d", or->right->pl->stages[0].argv[0]);
+
+    // Groups are pipeline stages and take redirections
+    line = "{ x; y; } > f | (z) ;";
+    n = parse_line(&a, line, strlen(line), NULL);
+    TEST_ASSERT_NOT_NULL(n);
+    TEST_ASSERT_EQUAL_INT(NODE_PIPELINE, n->kind);
+    TEST_ASSERT_EQUAL_INT(2, n->pl->nstages);
+    const struct command *group = &n->pl->stages[0];
+    TEST_ASSERT_FALSE(group->subshell);
+    TEST_ASSERT_NULL(group->argv[0]);
+    TEST_ASSERT_EQUAL_INT(1, group->nredirs);
+    TEST_ASSERT_EQUAL_INT(NODE_SEQ, group->body->kind);
+    TEST_ASSERT_TRUE(n->pl->stages[1].subshell);
+
+    // Reserved words only count unquoted at the start of a command
+    line = "echo { '}' time";
+    n = parse_line(&a, line, strlen(line), NULL);
+    TEST_ASSERT_NOT_NULL(n);
+    TEST_ASSERT_EQUAL_STRING("}", n->pl->stages[0].argv[2]);
+
+    static const char *const bad[] = {
+        "a;;", "&& a", "a ||", "( a", "a )", "{ a }", "()", "a; }", "(a) b", "echo 'a",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        TEST_ASSERT_NULL(parse_line(&a, bad[i], strlen(bad[i]), &st));
+        TEST_ASSERT_EQUAL_INT(PARSE_SYNTAX, st);
+    }
+    // A comment is not an error, only nothing to run
+    TEST_ASSERT_NULL(parse_line(&a, "# a )", 5, &st));
+    TEST_ASSERT_EQUAL_INT(PARSE_EMPTY, st);
+    arena_destroy(&a);
+}
+
+// An executable with no #! line runs under /bin/sh, as with execvp
+void test_spawn_script_without_shebang(void)
+{
+    char path[] = "/tmp/lab-script-XXXXXX";
+    char out[sizeof(path) + 4];
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    const char *body = "echo \"$@\" >\"$0.out\"\n";
+    TEST_ASSERT_EQUAL_INT((int)strlen(body), write(fd, body, strlen(body)));
+    fchmod(fd, 0700);
+    close(fd);
+
+    char *argv[] = { path, "one", "two", NULL };
+    pid_t pid = spawn_cmd(path, argv, 0, -1, -1, -1, NULL);
+    TEST_ASSERT_TRUE(pid > 0);
+    int st;
+    waitpid(pid, &st, 0);
+    unlink(path);
+    TEST_ASSERT_TRUE(WIFEXITED(st) && WEXITSTATUS(st) == 0);
+
+    snprintf(out, sizeof(out), "%s.out", path);
+    char buf[64];
+    fd = open(out, O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    unlink(out);
+    TEST_ASSERT_TRUE(n > 0);
+    buf[n] = '\0';
+    TEST_ASSERT_EQUAL_STRING("one two\n", buf);
+}
+
+// A cached tree is a copy that outlives the line and the arena it came from
+void test_ast_cache(void)
+{
+    struct ast_cache c;
+    struct arena a;
+    struct node *parsed;
+    enum parse_status st;
+    ast_cache_init(&c);
+    arena_init(&a, 0);
+
+    // Only a line seen before is copied
+    char line[] = "ls -l > out && { echo hi; } <<< x";
+    size_t len = strlen(line);
+    const struct node *first = ast_cache_parse(&c, &a, line, len, &parsed, NULL);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_EQUAL_PTR(first, parsed);
+    TEST_ASSERT_EQUAL_INT(0, c.count);
+    const struct node *second = ast_cache_parse(&c, &a, line, len, &parsed, NULL);
+    TEST_ASSERT_EQUAL_PTR(parsed, second);
+    TEST_ASSERT_EQUAL_INT(1, c.count);
+    arena_reset(&a);
+
+    // Hits return the cached copy, which survived the reset
+    const struct node *tree = ast_cache_parse(&c, &a, line, len, &parsed, NULL);
+    TEST_ASSERT_NOT_NULL(tree);
+    TEST_ASSERT_NULL(parsed);
+    memset(line + 3, 'X', 2);
+    TEST_ASSERT_TRUE(tree != ast_cache_parse(&c, &a, line, len, &parsed, NULL));
+    TEST_ASSERT_NOT_NULL(parsed);
+    memcpy(line + 3, "-l", 2);
+    TEST_ASSERT_EQUAL_PTR(tree, ast_cache_parse(&c, &a, line, len, &parsed, NULL));
+
+    TEST_ASSERT_EQUAL_INT(NODE_AND, tree->kind);
+    const struct command *ls = &tree->left->pl->stages[0];
+    TEST_ASSERT_EQUAL_STRING("-l", ls->argv[1]);
+    TEST_ASSERT_EQUAL_STRING("out", ls->redirs[0].word);
+    TEST_ASSERT_EQUAL_INT(0, strncmp("ls -l > out", tree->left->pl->text,
+                                     tree->left->pl->textlen));
+    const struct command *group = &tree->right->pl->stages[0];
+    TEST_ASSERT_EQUAL_STRING("x\n", group->redirs[0].word);
+    TEST_ASSERT_EQUAL_STRING("hi", group->body->pl->stages[0].argv[1]);
+
+    // Here-documents and syntax errors are not kept
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_NOT_NULL(ast_cache_parse(&c, &a, "cat <<E", 7, &parsed, NULL));
+        TEST_ASSERT_NOT_NULL(parsed);
+        TEST_ASSERT_NULL(ast_cache_parse(&c, &a, "a |", 3, &parsed, &st));
+        TEST_ASSERT_EQUAL_INT(PARSE_SYNTAX, st);
+    }
+    TEST_ASSERT_EQUAL_INT(1, c.count);
+
+    // Filling the cache drops the least recently used line: cmd0, since
+    // the first line was looked up after it was added
+    char buf[16];
+    for (int i = 0; i < AST_CACHE_SIZE; i++) {
+        int n = snprintf(buf, sizeof(buf), "cmd%d", i);
+        ast_cache_parse(&c, &a, buf, n, &parsed, NULL);
+        ast_cache_parse(&c, &a, buf, n, &parsed, NULL);
+        if (i == 0) TEST_ASSERT_EQUAL_PTR(tree, ast_cache_parse(&c, &a, line, len, &parsed, NULL));
+    }
+    TEST_ASSERT_EQUAL_INT(AST_CACHE_SIZE, c.count);
+    ast_cache_parse(&c, &a, "cmd1", 4, &parsed, NULL);
+    TEST_ASSERT_NULL(parsed);
+    ast_cache_parse(&c, &a, "cmd0", 4, &parsed, NULL);
+    TEST_ASSERT_NOT_NULL(parsed);
+    TEST_ASSERT_EQUAL_PTR(tree, ast_cache_parse(&c, &a, line, len, &parsed, NULL));
+
+    ast_cache_destroy(&c);
+    TEST_ASSERT_EQUAL_INT(0, c.count);
+    arena_destroy(&a);
+}
 
 int main(void) {
 UNITY_BEGIN();
@@ -258,5 +1310,41 @@ RUN_TEST(test_get_prompt_default_empty_env);
 RUN_TEST(test_get_prompt_custom_env);
 RUN_TEST(test_ch_dir_invalid);
 RUN_TEST(test_ch_dir_empty);
+RUN_TEST(test_cmd_parse_extra_spaces);
+RUN_TEST(test_arena_reset_reuses_memory);
+RUN_TEST(test_arena_large_alloc);
+RUN_TEST(test_cmd_hash_lookup);
+RUN_TEST(test_cmd_hash_path_change);
+RUN_TEST(test_parse_line_pipeline);
+RUN_TEST(test_parse_line_pipeline_empty_stage);
+RUN_TEST(test_lexer_operators);
+RUN_TEST(test_cmd_parse_quotes);
+RUN_TEST(test_sink_writes_in_order);
+RUN_TEST(test_sink_waits_when_full);
+RUN_TEST(test_scan_impls_match_scalar);
+RUN_TEST(test_scan_space_matches_isspace);
+RUN_TEST(test_jobs_table);
+RUN_TEST(test_job_update_state);
+RUN_TEST(test_parse_line_pipeline_background);
+RUN_TEST(test_prompt_render_cache);
+RUN_TEST(test_prompt_render_cwd);
+RUN_TEST(test_input_string_lines);
+RUN_TEST(test_input_fd_lines);
+RUN_TEST(test_input_shared_fd);
+RUN_TEST(test_input_file_mapped);
+RUN_TEST(test_parse_line_pipeline_time);
+RUN_TEST(test_rusage_add_and_print);
+RUN_TEST(test_time_group);
+RUN_TEST(test_shstat_json);
+RUN_TEST(test_builtin_find);
+RUN_TEST(test_histfile_append_load_trim);
+RUN_TEST(test_histindex_search);
+RUN_TEST(test_histindex_histcontrol);
+RUN_TEST(test_parse_line_pipeline_redirs);
+RUN_TEST(test_redir_save_restore);
+RUN_TEST(test_heredoc_read);
+RUN_TEST(test_parse_line_lists);
+RUN_TEST(test_ast_cache);
+RUN_TEST(test_spawn_script_without_shebang);
 return UNITY_END();
 }